@@ -17,7 +17,9 @@
  */
 
 
+#include <config.h>
 #include <string.h>
+#include <unistd.h>
 #include <codecVC.h>
 #include <glib.h>
 #include "vmeta_allocator.h"
@@ -57,6 +59,19 @@ GstAllocator* gst_vmeta_allocator_new(GstVmetaAllocatorType type)
 }
 
 
+GstAllocator* gst_vmeta_allocator_new_dmabuf(GstVmetaAllocatorType type)
+{
+#ifdef HAVE_VDEC_OS_DMA_EXPORT_FD
+	GstAllocator *allocator = gst_vmeta_allocator_new(type);
+	GST_VMETA_ALLOCATOR(allocator)->export_dmabuf = TRUE;
+	return allocator;
+#else
+	(void)type;
+	return NULL;
+#endif
+}
+
+
 static char const * gst_vmeta_get_alloctype_string(GstVmetaAllocatorType type)
 {
 	switch (type)
@@ -88,6 +103,8 @@ static void gst_vmeta_allocator_init(GstVmetaAllocator *allocator)
 {
 	GstAllocator *parent = GST_ALLOCATOR(allocator);
 
+	allocator->export_dmabuf = FALSE;
+
 	parent->mem_type    = gst_vmeta_get_alloctype_string(allocator->type);
 	parent->mem_map     = GST_DEBUG_FUNCPTR(gst_vmeta_allocator_map);
 	parent->mem_unmap   = GST_DEBUG_FUNCPTR(gst_vmeta_allocator_unmap);
@@ -109,6 +126,7 @@ static GstVmetaMemory* gst_vmeta_mem_new_internal(GstVmetaAllocator *vmeta_alloc
 	GstVmetaMemory *vmeta_mem;
 	vmeta_mem = g_slice_alloc(sizeof(GstVmetaMemory));
 	vmeta_mem->virt_addr = NULL;
+	vmeta_mem->dmabuf_fd = -1;
 
 	gst_memory_init(GST_MEMORY_CAST(vmeta_mem), flags, GST_ALLOCATOR_CAST(vmeta_alloc), parent, maxsize, align, offset, size);
 
@@ -159,6 +177,20 @@ static GstVmetaMemory* gst_vmeta_alloc_internal(GstAllocator *allocator, GstMemo
 		return NULL;
 	}
 
+#ifdef HAVE_VDEC_OS_DMA_EXPORT_FD
+	if (vmeta_alloc->export_dmabuf)
+	{
+		vmeta_mem->dmabuf_fd = vdec_os_api_dma_export_fd(vmeta_mem->virt_addr);
+		if (vmeta_mem->dmabuf_fd < 0)
+		{
+			GST_ERROR_OBJECT(allocator, "could not export %u byte of DMA memory as dma-buf", maxsize);
+			vdec_os_api_dma_free(vmeta_mem->virt_addr);
+			g_slice_free1(sizeof(GstVmetaMemory), vmeta_mem);
+			return NULL;
+		}
+	}
+#endif
+
 	padding = maxsize - (offset + size);
 
 	if ((offset > 0) && (flags & GST_MEMORY_FLAG_ZERO_PREFIXED))
@@ -185,6 +217,8 @@ static GstMemory* gst_vmeta_allocator_alloc(GstAllocator *allocator, gsize size,
 	maxsize = size + params->prefix + params->padding;
 
 	vmeta_mem = gst_vmeta_alloc_internal(allocator, NULL, maxsize, params->flags, params->align, params->prefix, size);
+	if (vmeta_mem == NULL)
+		return NULL;
 
 	GST_DEBUG_OBJECT(
 		allocator,
@@ -216,6 +250,8 @@ static void gst_vmeta_allocator_free(GstAllocator *allocator, GstMemory *memory)
 	);
 
 	vdec_os_api_dma_free(vmeta_mem->virt_addr);
+	if ((vmeta_mem->dmabuf_fd >= 0) && (memory->parent == NULL))
+		close(vmeta_mem->dmabuf_fd);
 
 	vmeta_mem->virt_addr = (void*)0xDDDDDDDD;
 	vmeta_mem->phys_addr = 0xDDDDDDDD;
@@ -294,6 +330,7 @@ static GstMemory* gst_vmeta_allocator_share(GstMemory *mem, gssize offset, gssiz
 	);
 	sub->virt_addr = vmeta_mem->virt_addr;
 	sub->phys_addr = vmeta_mem->phys_addr;
+	sub->dmabuf_fd = vmeta_mem->dmabuf_fd;
 
 	GST_DEBUG_OBJECT(
 		mem->allocator,
@@ -61,6 +61,7 @@ struct _GstVmetaAllocator
 	GstAllocator parent;
 
 	GstVmetaAllocatorType type;
+	gboolean export_dmabuf;
 };
 
 
@@ -76,12 +77,18 @@ struct _GstVmetaMemory
 
 	void *virt_addr;
 	UNSG32 phys_addr;
+	/* dma-buf file descriptor of the block, or -1 if the allocator does not export them;
+	 * owned by the memory (sub-memories share the parent's descriptor) */
+	gint dmabuf_fd;
 };
 
 
 GType gst_vmeta_allocator_get_type(void);
 
 GstAllocator* gst_vmeta_allocator_new(GstVmetaAllocatorType type);
+/* Like gst_vmeta_allocator_new(), but each block is also exported as a dma-buf (see the dmabuf_fd
+ * field of GstVmetaMemory). Returns NULL if the vMeta libraries cannot export DMA memory. */
+GstAllocator* gst_vmeta_allocator_new_dmabuf(GstVmetaAllocatorType type);
 
 
 G_END_DECLS
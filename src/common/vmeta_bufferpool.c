@@ -17,8 +17,13 @@
  */
 
 
+#include <config.h>
 #include <codecVC.h>
 #include <string.h>
+#include <unistd.h>
+#ifdef HAVE_VMETA_DMABUF_EXPORT
+#include <gst/allocators/gstdmabuf.h>
+#endif
 #include "vmeta_bufferpool.h"
 
 
@@ -29,8 +34,11 @@ GST_DEBUG_CATEGORY (vmetabufferpool_debug);
 static gboolean gst_vmeta_buffer_meta_init(GstMeta *meta, G_GNUC_UNUSED gpointer params, G_GNUC_UNUSED GstBuffer *buffer);
 static void gst_vmeta_buffer_meta_free(GstMeta *meta, G_GNUC_UNUSED GstBuffer *buffer);
 
+static void gst_vmeta_buffer_pool_update_layout(GstVmetaBufferPool *vmeta_pool);
+
 static const gchar ** gst_vmeta_buffer_pool_get_options(GstBufferPool *pool);
 static gboolean gst_vmeta_buffer_pool_set_config(GstBufferPool *pool, GstStructure *config);
+static GstFlowReturn gst_vmeta_buffer_pool_acquire_buffer(GstBufferPool *pool, GstBuffer **buffer, GstBufferPoolAcquireParams *params);
 static GstFlowReturn gst_vmeta_buffer_pool_alloc_buffer(GstBufferPool *pool, GstBuffer **buffer, GstBufferPoolAcquireParams *params);
 static void gst_vmeta_buffer_pool_finalize(GObject *object);
 
@@ -43,6 +51,8 @@ G_DEFINE_TYPE(GstVmetaBufferPool, gst_vmeta_buffer_pool, GST_TYPE_BUFFER_POOL)
 static gboolean gst_vmeta_buffer_meta_init(GstMeta *meta, G_GNUC_UNUSED gpointer params, G_GNUC_UNUSED GstBuffer *buffer)
 {
 	GstVmetaBufferMeta *vmeta_meta = (GstVmetaBufferMeta *)meta;
+	vmeta_meta->dma_mem = NULL;
+	vmeta_meta->owns_dma_mem = FALSE;
 	vmeta_meta->mvl_ipp_data = NULL;
 	vmeta_meta->mvl_ipp_data_size = 0;
 	return TRUE;
@@ -58,6 +68,12 @@ static void gst_vmeta_buffer_meta_free(GstMeta *meta, G_GNUC_UNUSED GstBuffer *b
 		vmeta_meta->mvl_ipp_data = NULL;
 		vmeta_meta->mvl_ipp_data_size = 0;
 	}
+	if (vmeta_meta->owns_dma_mem && (vmeta_meta->dma_mem != NULL))
+	{
+		gst_memory_unref((GstMemory *)(vmeta_meta->dma_mem));
+		vmeta_meta->dma_mem = NULL;
+		vmeta_meta->owns_dma_mem = FALSE;
+	}
 }
 
 
@@ -99,6 +115,41 @@ GstMetaInfo const * gst_vmeta_buffer_meta_get_info(void)
 
 
 
+static void gst_vmeta_buffer_pool_update_layout(GstVmetaBufferPool *vmeta_pool)
+{
+	GstVideoInfo *info = &(vmeta_pool->video_info);
+	gint stride = vmeta_pool->dis_stride;
+	guint height = (vmeta_pool->dis_height != 0) ? vmeta_pool->dis_height : (guint)GST_VIDEO_INFO_HEIGHT(info);
+	gsize luma_size = (gsize)stride * height;
+
+	/* The engine writes the planes one after the other into the DMA buffer; the chroma
+	 * planes start right after the padded luma plane. For UYVY, only one plane is used. */
+	switch (GST_VIDEO_INFO_FORMAT(info))
+	{
+		case GST_VIDEO_FORMAT_I420:
+			info->offset[0] = 0;
+			info->offset[1] = luma_size;
+			info->offset[2] = luma_size + luma_size / 4;
+			info->stride[0] = stride;
+			info->stride[1] = stride / 2;
+			info->stride[2] = stride / 2;
+			break;
+		case GST_VIDEO_FORMAT_NV12:
+			info->offset[0] = 0;
+			info->offset[1] = luma_size;
+			info->stride[0] = stride;
+			info->stride[1] = stride;
+			break;
+		default:
+			info->offset[0] = 0;
+			info->stride[0] = stride;
+			break;
+	}
+
+	info->size = vmeta_pool->dis_size;
+}
+
+
 static const gchar ** gst_vmeta_buffer_pool_get_options(G_GNUC_UNUSED GstBufferPool *pool)
 {
 	static const gchar *options[] =
@@ -139,13 +190,11 @@ static gboolean gst_vmeta_buffer_pool_set_config(GstBufferPool *pool, GstStructu
 		return FALSE;
 	}
 
-	/* This vMeta decoded uses UYVY as the output format. For UYVY, only one plane is used.
-	 * -> Only the first stride value has to be set. */
+	/* The plane layout is given by the DMA buffers, not by the caps */
 	vmeta_pool->video_info = info;
-	vmeta_pool->video_info.stride[0] = vmeta_pool->dis_stride;
-	vmeta_pool->video_info.size = size;
-
 	vmeta_pool->dis_size = size;
+	gst_vmeta_buffer_pool_update_layout(vmeta_pool);
+
 	vmeta_pool->add_videometa = gst_buffer_pool_config_has_option(config, GST_BUFFER_POOL_OPTION_VIDEO_META);
 
 	GST_INFO_OBJECT(pool, "pool configured:  video info stride: %u  dis size: %u", vmeta_pool->dis_stride, size);
@@ -204,6 +253,30 @@ static GstFlowReturn gst_vmeta_buffer_pool_alloc_buffer(GstBufferPool *pool, Gst
 	vmeta_meta->mvl_ipp_data = picture;
 	vmeta_meta->mvl_ipp_data_size = sizeof(IppVmetaPicture);
 
+#ifdef HAVE_VMETA_DMABUF_EXPORT
+	/* The dma-buf memory maps the same pages as the vMeta memory, which the
+	 * meta keeps alive for the video engine and for the phys_addr users */
+	if ((vmeta_pool->dmabuf_allocator != NULL) && (vmeta_mem->dmabuf_fd >= 0))
+	{
+		GstMemory *dmabuf_mem;
+		gint fd = dup(vmeta_mem->dmabuf_fd);
+
+		dmabuf_mem = (fd >= 0) ? gst_dmabuf_allocator_alloc(vmeta_pool->dmabuf_allocator, fd, vmeta_pool->dis_size) : NULL;
+		if (dmabuf_mem == NULL)
+		{
+			GST_ERROR_OBJECT(pool, "could not wrap dma-buf %d in a memory block", vmeta_mem->dmabuf_fd);
+			if (fd >= 0)
+				close(fd);
+			gst_memory_unref(mem);
+			gst_buffer_unref(buf);
+			return GST_FLOW_ERROR;
+		}
+
+		vmeta_meta->owns_dma_mem = TRUE;
+		mem = dmabuf_mem;
+	}
+#endif
+
 	gst_buffer_append_memory(buf, mem);
 
 	if (vmeta_pool->add_videometa)
@@ -225,6 +298,43 @@ static GstFlowReturn gst_vmeta_buffer_pool_alloc_buffer(GstBufferPool *pool, Gst
 }
 
 
+static GstFlowReturn gst_vmeta_buffer_pool_acquire_buffer(GstBufferPool *pool, GstBuffer **buffer, GstBufferPoolAcquireParams *params)
+{
+	GstVmetaBufferPool *vmeta_pool;
+	GstVideoMeta *video_meta;
+	GstVideoInfo *info;
+	GstFlowReturn flow_ret;
+
+	flow_ret = GST_BUFFER_POOL_CLASS(gst_vmeta_buffer_pool_parent_class)->acquire_buffer(pool, buffer, params);
+	if (flow_ret != GST_FLOW_OK)
+		return flow_ret;
+
+	vmeta_pool = GST_VMETA_BUFFER_POOL(pool);
+	info = &vmeta_pool->video_info;
+
+	/* The video info may have changed since the buffer was allocated, if the pool is
+	 * reused after a resolution change (see gst_vmeta_buffer_pool_set_video_info()) */
+	video_meta = gst_buffer_get_video_meta(*buffer);
+	if ((video_meta != NULL) && ((video_meta->format != GST_VIDEO_INFO_FORMAT(info)) || ((gint)(video_meta->width) != GST_VIDEO_INFO_WIDTH(info)) || ((gint)(video_meta->height) != GST_VIDEO_INFO_HEIGHT(info)) || (video_meta->stride[0] != info->stride[0]) || (video_meta->offset[0] != info->offset[0]) || (video_meta->offset[1] != info->offset[1])))
+	{
+		guint i;
+
+		GST_LOG_OBJECT(pool, "updating video meta of buffer %p to %s %dx%d stride %d", (gpointer)(*buffer), gst_video_format_to_string(GST_VIDEO_INFO_FORMAT(info)), GST_VIDEO_INFO_WIDTH(info), GST_VIDEO_INFO_HEIGHT(info), info->stride[0]);
+		video_meta->format = GST_VIDEO_INFO_FORMAT(info);
+		video_meta->width = GST_VIDEO_INFO_WIDTH(info);
+		video_meta->height = GST_VIDEO_INFO_HEIGHT(info);
+		video_meta->n_planes = GST_VIDEO_INFO_N_PLANES(info);
+		for (i = 0; i < video_meta->n_planes; ++i)
+		{
+			video_meta->offset[i] = info->offset[i];
+			video_meta->stride[i] = info->stride[i];
+		}
+	}
+
+	return GST_FLOW_OK;
+}
+
+
 static void gst_vmeta_buffer_pool_finalize(GObject *object)
 {
 	GstVmetaBufferPool *vmeta_pool = GST_VMETA_BUFFER_POOL(object);
@@ -237,6 +347,8 @@ static void gst_vmeta_buffer_pool_finalize(GObject *object)
 	 * class will shut down the allocated memory blocks, for which the allocator must
 	 * exist */
 	gst_object_unref(vmeta_pool->allocator);
+	if (vmeta_pool->dmabuf_allocator != NULL)
+		gst_object_unref(vmeta_pool->dmabuf_allocator);
 }
 
 
@@ -249,41 +361,121 @@ static void gst_vmeta_buffer_pool_class_init(GstVmetaBufferPoolClass *klass)
 
 	object_class->finalize     = GST_DEBUG_FUNCPTR(gst_vmeta_buffer_pool_finalize);
 	parent_class->get_options  = GST_DEBUG_FUNCPTR(gst_vmeta_buffer_pool_get_options);
-	parent_class->set_config   = GST_DEBUG_FUNCPTR(gst_vmeta_buffer_pool_set_config);
-	parent_class->alloc_buffer = GST_DEBUG_FUNCPTR(gst_vmeta_buffer_pool_alloc_buffer);
+	parent_class->set_config     = GST_DEBUG_FUNCPTR(gst_vmeta_buffer_pool_set_config);
+	parent_class->acquire_buffer = GST_DEBUG_FUNCPTR(gst_vmeta_buffer_pool_acquire_buffer);
+	parent_class->alloc_buffer   = GST_DEBUG_FUNCPTR(gst_vmeta_buffer_pool_alloc_buffer);
 }
 
 
 static void gst_vmeta_buffer_pool_init(GstVmetaBufferPool *pool)
 {
+	pool->allocator = NULL;
+	pool->dmabuf_allocator = NULL;
 	pool->dis_stride = -1;
+	pool->dis_height = 0;
 	pool->add_videometa = FALSE;
 
 	GST_DEBUG_OBJECT(pool, "initializing vMeta buffer pool");
 }
 
 
-GstBufferPool *gst_vmeta_buffer_pool_new(GstVmetaAllocatorType alloc_type, gboolean read_only)
+GstBufferPool *gst_vmeta_buffer_pool_new(GstVmetaAllocatorType alloc_type, gboolean read_only, gboolean export_dmabuf)
 {
 	GstVmetaBufferPool *vmeta_pool;
 
 	vmeta_pool = g_object_new(gst_vmeta_buffer_pool_get_type(), NULL);
-	vmeta_pool->allocator = gst_vmeta_allocator_new(alloc_type);
 	vmeta_pool->read_only = read_only;
 
+	if (export_dmabuf)
+	{
+#ifdef HAVE_VMETA_DMABUF_EXPORT
+		vmeta_pool->allocator = gst_vmeta_allocator_new_dmabuf(alloc_type);
+		if (vmeta_pool->allocator != NULL)
+			vmeta_pool->dmabuf_allocator = gst_dmabuf_allocator_new();
+#endif
+		if (vmeta_pool->allocator == NULL)
+			GST_WARNING_OBJECT(vmeta_pool, "dma-buf export is not supported; using regular buffers");
+	}
+
+	if (vmeta_pool->allocator == NULL)
+		vmeta_pool->allocator = gst_vmeta_allocator_new(alloc_type);
+
 	return GST_BUFFER_POOL_CAST(vmeta_pool);
 }
 
 
-void gst_vmeta_buffer_pool_set_dis_info(GstBufferPool *pool, gsize dis_size, gint dis_stride)
+gboolean gst_vmeta_buffer_pool_exports_dmabuf(GstBufferPool *pool)
+{
+	return GST_VMETA_BUFFER_POOL(pool)->dmabuf_allocator != NULL;
+}
+
+
+void gst_vmeta_buffer_pool_set_dis_info(GstBufferPool *pool, gsize dis_size, gint dis_stride, guint dis_height)
 {
 	GstVmetaBufferPool *vmeta_pool = GST_VMETA_BUFFER_POOL(pool);
 
 	vmeta_pool->dis_size = dis_size;
 	vmeta_pool->dis_stride = dis_stride;
+	vmeta_pool->dis_height = dis_height;
 
-	GST_LOG_OBJECT(pool, "set_dis_info:  video info stride: %u  dis size: %u", dis_stride, dis_size);
+	GST_LOG_OBJECT(pool, "set_dis_info:  video info stride: %u  dis size: %u  dis height: %u", dis_stride, dis_size, dis_height);
 
-	vmeta_pool->video_info.stride[0] = dis_stride;
+	gst_vmeta_buffer_pool_update_layout(vmeta_pool);
 }
 
+
+void gst_vmeta_buffer_pool_set_video_info(GstBufferPool *pool, GstVideoInfo const *info)
+{
+	GstVmetaBufferPool *vmeta_pool = GST_VMETA_BUFFER_POOL(pool);
+
+	/* Like in set_config, the plane layout and size are given by the DMA buffers */
+	vmeta_pool->video_info = *info;
+	gst_vmeta_buffer_pool_update_layout(vmeta_pool);
+
+	GST_LOG_OBJECT(pool, "set_video_info:  %dx%d  stride: %d", GST_VIDEO_INFO_WIDTH(info), GST_VIDEO_INFO_HEIGHT(info), vmeta_pool->dis_stride);
+}
+
+
+
+void gst_vmeta_buffer_pool_set_video_meta_window(GstBuffer *buffer, guint x, guint y, guint width, guint height)
+{
+	GstVmetaBufferPool *vmeta_pool;
+	GstVideoMeta *video_meta;
+	GstVideoInfo *info;
+	guint i;
+
+	if ((buffer->pool == NULL) || !GST_IS_VMETA_BUFFER_POOL(buffer->pool))
+		return;
+
+	video_meta = gst_buffer_get_video_meta(buffer);
+	if (video_meta == NULL)
+		return;
+
+	vmeta_pool = GST_VMETA_BUFFER_POOL(buffer->pool);
+	info = &(vmeta_pool->video_info);
+
+	video_meta->format = GST_VIDEO_INFO_FORMAT(info);
+	video_meta->width = width;
+	video_meta->height = height;
+	video_meta->n_planes = GST_VIDEO_INFO_N_PLANES(info);
+	for (i = 0; i < video_meta->n_planes; ++i)
+		video_meta->stride[i] = info->stride[i];
+
+	/* The chroma planes are subsampled by 2 in both directions for the 4:2:0 formats;
+	 * in UYVY, a horizontal pair of pixels shares one 4-byte macropixel */
+	switch (GST_VIDEO_INFO_FORMAT(info))
+	{
+		case GST_VIDEO_FORMAT_I420:
+			video_meta->offset[0] = info->offset[0] + y * info->stride[0] + x;
+			video_meta->offset[1] = info->offset[1] + (y / 2) * info->stride[1] + x / 2;
+			video_meta->offset[2] = info->offset[2] + (y / 2) * info->stride[2] + x / 2;
+			break;
+		case GST_VIDEO_FORMAT_NV12:
+			video_meta->offset[0] = info->offset[0] + y * info->stride[0] + x;
+			video_meta->offset[1] = info->offset[1] + (y / 2) * info->stride[1] + (x / 2) * 2;
+			break;
+		default:
+			video_meta->offset[0] = info->offset[0] + y * info->stride[0] + (x / 2) * 4;
+			break;
+	}
+}
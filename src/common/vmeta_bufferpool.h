@@ -38,6 +38,7 @@ typedef struct _GstVmetaBufferPoolClass GstVmetaBufferPoolClass;
 #define GST_TYPE_VMETA_BUFFER_POOL             (gst_vmeta_buffer_pool_get_type())
 #define GST_VMETA_BUFFER_POOL(obj)             (G_TYPE_CHECK_INSTANCE_CAST((obj), GST_TYPE_VMETA_BUFFER_POOL, GstVmetaBufferPool))
 #define GST_VMETA_BUFFER_POOL_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST((klass), GST_TYPE_VMETA_BUFFER_POOL, GstVmetaBufferPoolClass))
+#define GST_IS_VMETA_BUFFER_POOL(obj)          (G_TYPE_CHECK_INSTANCE_TYPE((obj), GST_TYPE_VMETA_BUFFER_POOL))
 
 #define GST_VMETA_BUFFER_META_GET(buffer)      ((GstVmetaBufferMeta *)gst_buffer_get_meta((buffer), gst_vmeta_buffer_meta_api_get_type()))
 #define GST_VMETA_BUFFER_META_ADD(buffer)      ((GstVmetaBufferMeta *)gst_buffer_add_meta((buffer), gst_vmeta_buffer_meta_get_info(), NULL))
@@ -51,6 +52,9 @@ struct _GstVmetaBufferMeta
 	GstMeta meta;
 
 	GstVmetaMemory *dma_mem;
+	/* If the buffer's memory is a dma-buf memory which wraps dma_mem, the meta holds
+	 * the reference to dma_mem; otherwise, dma_mem is the buffer's memory */
+	gboolean owns_dma_mem;
 
 	/* IPP structures like IppVmetaPicture are stored here */
 	void *mvl_ipp_data;
@@ -63,8 +67,11 @@ struct _GstVmetaBufferPool
 	GstBufferPool bufferpool;
 
 	GstAllocator *allocator;
+	/* Only set if the pictures are exported as dma-bufs */
+	GstAllocator *dmabuf_allocator;
 	gsize dis_size;
 	gint dis_stride;
+	guint dis_height;
 	GstVideoInfo video_info;
 	gboolean add_videometa;
 	gboolean read_only;
@@ -81,8 +88,23 @@ GType gst_vmeta_buffer_meta_api_get_type(void);
 GstMetaInfo const * gst_vmeta_buffer_meta_get_info(void);
 
 GType gst_vmeta_buffer_pool_get_type(void);
-GstBufferPool *gst_vmeta_buffer_pool_new(GstVmetaAllocatorType alloc_type, gboolean read_only);
-void gst_vmeta_buffer_pool_set_dis_info(GstBufferPool *pool, gsize dis_size, gint dis_stride);
+/* If export_dmabuf is TRUE, the buffers contain dma-buf memory (which can be passed to other
+ * devices and processes) instead of the vMeta memory itself; the vMeta memory is still reachable
+ * through the buffers' GstVmetaBufferMeta. If dma-bufs cannot be exported, this falls back
+ * to regular buffers. */
+GstBufferPool *gst_vmeta_buffer_pool_new(GstVmetaAllocatorType alloc_type, gboolean read_only, gboolean export_dmabuf);
+gboolean gst_vmeta_buffer_pool_exports_dmabuf(GstBufferPool *pool);
+/* dis_stride is the stride of the first plane, dis_height the padded height of the pictures;
+ * the offsets and strides of the other planes are derived from these */
+void gst_vmeta_buffer_pool_set_dis_info(GstBufferPool *pool, gsize dis_size, gint dis_stride, guint dis_height);
+/* Updates the video info of an active pool; the video metas of its buffers are
+ * updated accordingly when they are acquired. Call gst_vmeta_buffer_pool_set_dis_info()
+ * first if the stride changed. */
+void gst_vmeta_buffer_pool_set_video_info(GstBufferPool *pool, GstVideoInfo const *info);
+/* Sets up the video meta of a buffer from a vMeta buffer pool so that it describes only the given
+ * window of the picture; the offsets then point to the window's top left corner. Does nothing if
+ * the buffer has no video meta or does not come from a vMeta buffer pool. */
+void gst_vmeta_buffer_pool_set_video_meta_window(GstBuffer *buffer, guint x, guint y, guint width, guint height);
 
 
 G_END_DECLS
@@ -0,0 +1,230 @@
+/* vMeta engine scheduler
+ * Copyright (C) 2013  Carlos Rafael Giani
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+
+#include "vmeta_scheduler.h"
+
+
+GST_DEBUG_CATEGORY_STATIC(vmetascheduler_debug);
+#define GST_CAT_DEFAULT vmetascheduler_debug
+
+
+struct _GstVmetaSchedulerClient
+{
+	/* Only used for logging; not ref'd, since the owner outlives the client */
+	GstObject *owner;
+
+	gint priority;
+	gboolean attached;
+
+	gboolean waiting;
+	guint64 ticket;
+
+	gint64 creation_time, acquire_time;
+	gint64 busy_time, wait_time;
+	guint64 num_slices;
+};
+
+
+/* The scheduler state is global, since there is only one engine per process.
+ * The client list is short (one entry per decoder element), so it is simply
+ * scanned whenever the next engine holder has to be determined. */
+static GMutex scheduler_mutex;
+static GCond scheduler_cond;
+static GSList *scheduler_clients = NULL;
+static GstVmetaSchedulerClient *scheduler_holder = NULL;
+static guint64 scheduler_next_ticket = 0;
+static guint scheduler_num_attached = 0;
+
+
+static gboolean gst_vmeta_scheduler_is_next(GstVmetaSchedulerClient *client);
+
+
+
+
+static gboolean gst_vmeta_scheduler_is_next(GstVmetaSchedulerClient *client)
+{
+	GSList *item;
+
+	for (item = scheduler_clients; item != NULL; item = item->next)
+	{
+		GstVmetaSchedulerClient *other = (GstVmetaSchedulerClient *)(item->data);
+
+		if ((other == client) || !other->waiting)
+			continue;
+
+		if ((other->priority > client->priority) || ((other->priority == client->priority) && (other->ticket < client->ticket)))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+GstVmetaSchedulerClient* gst_vmeta_scheduler_client_new(GstObject *owner, gint priority)
+{
+	static gsize debug_initialized = 0;
+	GstVmetaSchedulerClient *client;
+
+	if (g_once_init_enter(&debug_initialized))
+	{
+		GST_DEBUG_CATEGORY_INIT(vmetascheduler_debug, "vmetascheduler", 0, "vMeta engine scheduler");
+		g_once_init_leave(&debug_initialized, 1);
+	}
+
+	client = g_slice_new0(GstVmetaSchedulerClient);
+	client->owner = owner;
+	client->priority = priority;
+	client->creation_time = g_get_monotonic_time();
+
+	g_mutex_lock(&scheduler_mutex);
+	scheduler_clients = g_slist_prepend(scheduler_clients, client);
+	g_mutex_unlock(&scheduler_mutex);
+
+	GST_DEBUG_OBJECT(owner, "registered scheduler client %p with priority %d", (gpointer)client, priority);
+
+	return client;
+}
+
+
+void gst_vmeta_scheduler_client_free(GstVmetaSchedulerClient *client)
+{
+	if (client == NULL)
+		return;
+
+	g_assert(scheduler_holder != client);
+
+	gst_vmeta_scheduler_client_detach(client);
+
+	g_mutex_lock(&scheduler_mutex);
+	scheduler_clients = g_slist_remove(scheduler_clients, client);
+	g_mutex_unlock(&scheduler_mutex);
+
+	GST_DEBUG_OBJECT(client->owner, "unregistered scheduler client %p", (gpointer)client);
+
+	g_slice_free(GstVmetaSchedulerClient, client);
+}
+
+
+void gst_vmeta_scheduler_client_set_priority(GstVmetaSchedulerClient *client, gint priority)
+{
+	g_mutex_lock(&scheduler_mutex);
+	client->priority = priority;
+	/* A waiting client may have become the next engine holder */
+	g_cond_broadcast(&scheduler_cond);
+	g_mutex_unlock(&scheduler_mutex);
+}
+
+
+gboolean gst_vmeta_scheduler_client_attach(GstVmetaSchedulerClient *client)
+{
+	gboolean first_user;
+
+	g_mutex_lock(&scheduler_mutex);
+
+	if (client->attached)
+	{
+		g_mutex_unlock(&scheduler_mutex);
+		return FALSE;
+	}
+
+	first_user = (scheduler_num_attached == 0);
+	++scheduler_num_attached;
+	client->attached = TRUE;
+
+	g_mutex_unlock(&scheduler_mutex);
+
+	GST_DEBUG_OBJECT(client->owner, "attached to engine (first user: %s)", first_user ? "yes" : "no");
+
+	return first_user;
+}
+
+
+void gst_vmeta_scheduler_client_detach(GstVmetaSchedulerClient *client)
+{
+	g_mutex_lock(&scheduler_mutex);
+
+	if (client->attached)
+	{
+		--scheduler_num_attached;
+		client->attached = FALSE;
+	}
+
+	g_mutex_unlock(&scheduler_mutex);
+}
+
+
+void gst_vmeta_scheduler_acquire(GstVmetaSchedulerClient *client)
+{
+	gint64 request_time = g_get_monotonic_time();
+
+	g_mutex_lock(&scheduler_mutex);
+
+	g_assert(scheduler_holder != client);
+
+	client->waiting = TRUE;
+	client->ticket = scheduler_next_ticket++;
+
+	while ((scheduler_holder != NULL) || !gst_vmeta_scheduler_is_next(client))
+		g_cond_wait(&scheduler_cond, &scheduler_mutex);
+
+	client->waiting = FALSE;
+	client->acquire_time = g_get_monotonic_time();
+	client->wait_time += client->acquire_time - request_time;
+	++client->num_slices;
+	scheduler_holder = client;
+
+	g_mutex_unlock(&scheduler_mutex);
+}
+
+
+void gst_vmeta_scheduler_release(GstVmetaSchedulerClient *client)
+{
+	g_mutex_lock(&scheduler_mutex);
+
+	g_assert(scheduler_holder == client);
+
+	client->busy_time += g_get_monotonic_time() - client->acquire_time;
+	scheduler_holder = NULL;
+	g_cond_broadcast(&scheduler_cond);
+
+	g_mutex_unlock(&scheduler_mutex);
+}
+
+
+void gst_vmeta_scheduler_client_get_stats(GstVmetaSchedulerClient *client, GstVmetaSchedulerStats *stats)
+{
+	gint64 now, busy_time;
+
+	g_mutex_lock(&scheduler_mutex);
+
+	now = g_get_monotonic_time();
+
+	/* Include the current slice if the client holds the engine right now */
+	busy_time = client->busy_time;
+	if (scheduler_holder == client)
+		busy_time += now - client->acquire_time;
+
+	stats->busy_time = (GstClockTime)busy_time * GST_USECOND;
+	stats->wait_time = (GstClockTime)(client->wait_time) * GST_USECOND;
+	stats->elapsed_time = (GstClockTime)(now - client->creation_time) * GST_USECOND;
+	stats->num_slices = client->num_slices;
+	stats->occupancy = (now > client->creation_time) ? ((gdouble)busy_time / (gdouble)(now - client->creation_time)) : 0.0;
+
+	g_mutex_unlock(&scheduler_mutex);
+}
@@ -0,0 +1,74 @@
+/* vMeta engine scheduler
+ * Copyright (C) 2013  Carlos Rafael Giani
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+
+#ifndef VMETA_SCHEDULER_H
+#define VMETA_SCHEDULER_H
+
+#include <glib.h>
+#include <gst/gst.h>
+
+
+G_BEGIN_DECLS
+
+
+/* There is only one vMeta engine, but several elements in the same process may
+ * want to use it. The scheduler arbitrates the access: a client acquires the
+ * engine before driving it, and releases it at the next frame boundary. If
+ * several clients are waiting, the one with the highest priority gets the engine
+ * next; clients with the same priority get it in the order they asked for it. */
+
+
+typedef struct _GstVmetaSchedulerClient GstVmetaSchedulerClient;
+
+
+typedef struct
+{
+	/* Time the client held the engine, and time it waited for it, in nanoseconds */
+	GstClockTime busy_time, wait_time;
+	/* Time since the client was created, in nanoseconds */
+	GstClockTime elapsed_time;
+	/* Number of times the client acquired the engine */
+	guint64 num_slices;
+	/* Fraction of the elapsed time the client held the engine (0.0 - 1.0) */
+	gdouble occupancy;
+}
+GstVmetaSchedulerStats;
+
+
+GstVmetaSchedulerClient* gst_vmeta_scheduler_client_new(GstObject *owner, gint priority);
+void gst_vmeta_scheduler_client_free(GstVmetaSchedulerClient *client);
+
+void gst_vmeta_scheduler_client_set_priority(GstVmetaSchedulerClient *client, gint priority);
+
+/* Marks the client as having a decoder instance open in the engine; returns TRUE
+ * if no other client has one open, that is, if the client is the engine's first user */
+gboolean gst_vmeta_scheduler_client_attach(GstVmetaSchedulerClient *client);
+void gst_vmeta_scheduler_client_detach(GstVmetaSchedulerClient *client);
+
+/* Blocks until the client has exclusive access to the engine; not recursive */
+void gst_vmeta_scheduler_acquire(GstVmetaSchedulerClient *client);
+void gst_vmeta_scheduler_release(GstVmetaSchedulerClient *client);
+
+void gst_vmeta_scheduler_client_get_stats(GstVmetaSchedulerClient *client, GstVmetaSchedulerStats *stats);
+
+
+G_END_DECLS
+
+
+#endif
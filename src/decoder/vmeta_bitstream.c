@@ -0,0 +1,640 @@
+/* vMeta video decoder plugin - bitstream inspection
+ * Copyright (C) 2013  Carlos Rafael Giani
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+
+#include <string.h>
+#include "vmeta_bitstream.h"
+
+
+
+/* Only the first few bytes of headers are inspected here. Emulation prevention bytes
+ * (h.264 and VC-1 advanced profile) are not removed, since they cannot occur that
+ * early in the headers which are parsed. */
+
+
+
+typedef struct
+{
+	guint8 const *data;
+	gsize size;
+	gsize bit_pos;
+}
+GstVmetaBitReader;
+
+
+static gboolean gst_vmeta_bit_reader_read(GstVmetaBitReader *reader, guint num_bits, guint32 *value);
+static gboolean gst_vmeta_bit_reader_skip(GstVmetaBitReader *reader, guint num_bits);
+static gboolean gst_vmeta_bit_reader_read_ue(GstVmetaBitReader *reader, guint32 *value);
+
+static void gst_vmeta_bitstream_parse_vc1_sequence_header(GstVmetaBitstreamParser *parser, guint8 const *data, gsize size);
+static gboolean gst_vmeta_bitstream_get_h264_nal_flags(guint8 const *data, gsize size, GstVmetaPictureFlags *flags);
+static gboolean gst_vmeta_bitstream_get_h264_flags(GstVmetaBitstreamParser *parser, guint8 const *data, gsize size, GstVmetaPictureFlags *flags);
+static gboolean gst_vmeta_bitstream_get_mpeg2_flags(guint8 const *data, gsize size, GstVmetaPictureFlags *flags);
+static gboolean gst_vmeta_bitstream_get_mpeg4_flags(guint8 const *data, gsize size, GstVmetaPictureFlags *flags);
+static gboolean gst_vmeta_bitstream_get_vc1_flags(GstVmetaBitstreamParser *parser, guint8 const *data, gsize size, GstVmetaPictureFlags *flags);
+static gboolean gst_vmeta_bitstream_get_vc1m_flags(GstVmetaBitstreamParser *parser, guint8 const *data, gsize size, GstVmetaPictureFlags *flags);
+
+
+
+
+static gboolean gst_vmeta_bit_reader_read(GstVmetaBitReader *reader, guint num_bits, guint32 *value)
+{
+	guint i;
+
+	if ((reader->bit_pos + num_bits) > (reader->size * 8))
+		return FALSE;
+
+	*value = 0;
+	for (i = 0; i < num_bits; ++i, ++reader->bit_pos)
+		*value = (*value << 1) | ((reader->data[reader->bit_pos / 8] >> (7 - (reader->bit_pos % 8))) & 1);
+
+	return TRUE;
+}
+
+
+static gboolean gst_vmeta_bit_reader_skip(GstVmetaBitReader *reader, guint num_bits)
+{
+	if ((reader->bit_pos + num_bits) > (reader->size * 8))
+		return FALSE;
+
+	reader->bit_pos += num_bits;
+	return TRUE;
+}
+
+
+static gboolean gst_vmeta_bit_reader_read_ue(GstVmetaBitReader *reader, guint32 *value)
+{
+	guint32 bit, suffix;
+	guint num_leading_zeros = 0;
+
+	/* Exp-Golomb code: N leading zero bits, a one bit, then N suffix bits */
+	while (TRUE)
+	{
+		if (!gst_vmeta_bit_reader_read(reader, 1, &bit))
+			return FALSE;
+		if (bit == 1)
+			break;
+		if (++num_leading_zeros > 31)
+			return FALSE;
+	}
+
+	if (!gst_vmeta_bit_reader_read(reader, num_leading_zeros, &suffix))
+		return FALSE;
+
+	*value = (1u << num_leading_zeros) - 1 + suffix;
+	return TRUE;
+}
+
+
+
+
+static void gst_vmeta_bitstream_parse_vc1_sequence_header(GstVmetaBitstreamParser *parser, guint8 const *data, gsize size)
+{
+	GstVmetaBitReader reader = { data, size, 0 };
+	guint32 profile, interlace;
+
+	/* Advanced profile sequence header: PROFILE (2 bits), LEVEL (3), COLORDIFF_FORMAT (2),
+	 * FRMRTQ_POSTPROC (3), BITRTQ_POSTPROC (5), POSTPROCFLAG (1), MAX_CODED_WIDTH (12),
+	 * MAX_CODED_HEIGHT (12), PULLDOWN (1), INTERLACE (1) */
+	if (!gst_vmeta_bit_reader_read(&reader, 2, &profile) || (profile != 3))
+		return;
+	if (!gst_vmeta_bit_reader_skip(&reader, 3 + 2 + 3 + 5 + 1 + 12 + 12 + 1))
+		return;
+	if (!gst_vmeta_bit_reader_read(&reader, 1, &interlace))
+		return;
+
+	parser->vc1_interlace = interlace;
+}
+
+
+static gboolean gst_vmeta_bitstream_get_h264_nal_flags(guint8 const *data, gsize size, GstVmetaPictureFlags *flags)
+{
+	guint8 nal_header;
+	guint nal_ref_idc;
+
+	/* Returns TRUE if the NAL unit (data starts at the NAL header) is a slice, which decides the flags */
+
+	if (size < 1)
+		return FALSE;
+
+	nal_header = data[0];
+	nal_ref_idc = (nal_header >> 5) & 0x3;
+
+	switch (nal_header & 0x1f)
+	{
+		case 5: /* IDR slice */
+			*flags = GST_VMETA_PICTURE_FLAG_KEY | GST_VMETA_PICTURE_FLAG_REFERENCE;
+			return TRUE;
+		case 1: /* non-IDR slice */
+		case 2: /* slice data partition A */
+		{
+			GstVmetaBitReader reader = { data + 1, size - 1, 0 };
+			guint32 first_mb_in_slice, slice_type;
+
+			*flags = (nal_ref_idc != 0) ? GST_VMETA_PICTURE_FLAG_REFERENCE : 0;
+
+			/* slice_type: 2 and 7 are I slices, 4 and 9 are SI slices */
+			if (gst_vmeta_bit_reader_read_ue(&reader, &first_mb_in_slice)
+			 && gst_vmeta_bit_reader_read_ue(&reader, &slice_type)
+			 && (((slice_type % 5) == 2) || ((slice_type % 5) == 4)))
+				*flags |= GST_VMETA_PICTURE_FLAG_KEY;
+
+			return TRUE;
+		}
+		default:
+			return FALSE;
+	}
+}
+
+
+static gboolean gst_vmeta_bitstream_get_h264_flags(GstVmetaBitstreamParser *parser, guint8 const *data, gsize size, GstVmetaPictureFlags *flags)
+{
+	gsize offset;
+
+	/* The first slice NAL unit decides; nal_ref_idc is zero for non-reference pictures.
+	 * Non-IDR pictures made of I slices are treated as keyframes as well, since many
+	 * streams (broadcasts, for example) contain IDR pictures only rarely, if at all. */
+
+	if (parser->h264_nal_length_size > 0)
+	{
+		/* avc: each NAL unit is preceded by its big-endian length */
+		offset = 0;
+		while ((offset + parser->h264_nal_length_size) < size)
+		{
+			gsize nal_size = 0;
+			guint i;
+
+			for (i = 0; i < parser->h264_nal_length_size; ++i)
+				nal_size = (nal_size << 8) | data[offset + i];
+			offset += parser->h264_nal_length_size;
+
+			if (gst_vmeta_bitstream_get_h264_nal_flags(data + offset, MIN(nal_size, size - offset), flags))
+				return TRUE;
+
+			offset += nal_size;
+		}
+
+		return FALSE;
+	}
+
+	for (offset = gst_vmeta_bitstream_find_start_code(data, size, 0); (offset + 3) < size; offset = gst_vmeta_bitstream_find_start_code(data, size, offset + 3))
+	{
+		if (gst_vmeta_bitstream_get_h264_nal_flags(data + offset + 3, size - offset - 3, flags))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+
+static gboolean gst_vmeta_bitstream_get_mpeg2_flags(guint8 const *data, gsize size, GstVmetaPictureFlags *flags)
+{
+	gsize offset;
+
+	/* Picture header: start code 00 00 01 00, temporal_reference (10 bits), picture_coding_type (3 bits) */
+	for (offset = gst_vmeta_bitstream_find_start_code(data, size, 0); (offset + 5) < size; offset = gst_vmeta_bitstream_find_start_code(data, size, offset + 3))
+	{
+		if (data[offset + 3] != 0x00)
+			continue;
+
+		switch ((data[offset + 5] >> 3) & 0x7)
+		{
+			case 1: *flags = GST_VMETA_PICTURE_FLAG_KEY | GST_VMETA_PICTURE_FLAG_REFERENCE; return TRUE;
+			case 2: *flags = GST_VMETA_PICTURE_FLAG_REFERENCE; return TRUE;
+			case 3: *flags = 0; return TRUE;
+			default: return FALSE;
+		}
+	}
+
+	return FALSE;
+}
+
+
+static gboolean gst_vmeta_bitstream_get_mpeg4_flags(guint8 const *data, gsize size, GstVmetaPictureFlags *flags)
+{
+	gsize offset;
+
+	/* VOP header: start code 00 00 01 B6, vop_coding_type (2 bits); with packed bitstreams,
+	 * the first VOP is a P-VOP, so the whole access unit is considered a reference */
+	for (offset = gst_vmeta_bitstream_find_start_code(data, size, 0); (offset + 4) < size; offset = gst_vmeta_bitstream_find_start_code(data, size, offset + 3))
+	{
+		if (data[offset + 3] != 0xB6)
+			continue;
+
+		switch (data[offset + 4] >> 6)
+		{
+			case 0: *flags = GST_VMETA_PICTURE_FLAG_KEY | GST_VMETA_PICTURE_FLAG_REFERENCE; return TRUE;
+			case 2: *flags = 0; return TRUE;
+			default: *flags = GST_VMETA_PICTURE_FLAG_REFERENCE; return TRUE; /* P-VOP, S-VOP */
+		}
+	}
+
+	return FALSE;
+}
+
+
+static gboolean gst_vmeta_bitstream_get_vc1_flags(GstVmetaBitstreamParser *parser, guint8 const *data, gsize size, GstVmetaPictureFlags *flags)
+{
+	GstVmetaBitReader reader;
+	gsize offset, header_offset;
+	guint32 bits;
+
+	/* Pick up sequence headers, and find the frame start code; the frame start code is
+	 * optional, if it is missing, the data starts with the picture header */
+	header_offset = 0;
+	for (offset = gst_vmeta_bitstream_find_start_code(data, size, 0); (offset + 3) < size; offset = gst_vmeta_bitstream_find_start_code(data, size, offset + 3))
+	{
+		if (data[offset + 3] == 0x0F)
+			gst_vmeta_bitstream_parse_vc1_sequence_header(parser, data + offset + 4, size - offset - 4);
+		else if (data[offset + 3] == 0x0D)
+		{
+			header_offset = offset + 4;
+			break;
+		}
+	}
+
+	reader.data = data + header_offset;
+	reader.size = size - header_offset;
+	reader.bit_pos = 0;
+
+	/* FCM: 0 = progressive, 10 = frame interlace, 11 = field interlace */
+	if (parser->vc1_interlace)
+	{
+		if (!gst_vmeta_bit_reader_read(&reader, 1, &bits))
+			return FALSE;
+		if ((bits == 1) && (!gst_vmeta_bit_reader_read(&reader, 1, &bits) || (bits == 1)))
+		{
+			/* Field interlace; FPTYPE: 000 = I/I, 001 = I/P, 010 = P/I, 011 = P/P, 1xx = B/BI combinations */
+			if (!gst_vmeta_bit_reader_read(&reader, 3, &bits))
+				return FALSE;
+			if (bits == 0)
+				*flags = GST_VMETA_PICTURE_FLAG_KEY | GST_VMETA_PICTURE_FLAG_REFERENCE;
+			else
+				*flags = (bits < 4) ? GST_VMETA_PICTURE_FLAG_REFERENCE : 0;
+			return TRUE;
+		}
+	}
+
+	/* PTYPE: 0 = P, 10 = B, 110 = I, 1110 = BI, 1111 = skipped (a repeated P picture) */
+	if (!gst_vmeta_bit_reader_read(&reader, 1, &bits))
+		return FALSE;
+	if (bits == 0)
+	{
+		*flags = GST_VMETA_PICTURE_FLAG_REFERENCE;
+		return TRUE;
+	}
+	if (!gst_vmeta_bit_reader_read(&reader, 1, &bits))
+		return FALSE;
+	if (bits == 0)
+	{
+		*flags = 0;
+		return TRUE;
+	}
+	if (!gst_vmeta_bit_reader_read(&reader, 1, &bits))
+		return FALSE;
+	if (bits == 0)
+	{
+		*flags = GST_VMETA_PICTURE_FLAG_KEY | GST_VMETA_PICTURE_FLAG_REFERENCE;
+		return TRUE;
+	}
+	if (!gst_vmeta_bit_reader_read(&reader, 1, &bits))
+		return FALSE;
+	*flags = (bits == 0) ? 0 : GST_VMETA_PICTURE_FLAG_REFERENCE;
+	return TRUE;
+}
+
+
+static gboolean gst_vmeta_bitstream_get_vc1m_flags(GstVmetaBitstreamParser *parser, guint8 const *data, gsize size, GstVmetaPictureFlags *flags)
+{
+	GstVmetaBitReader reader = { data, size, 0 };
+	guint32 bits;
+
+	/* Simple/main profile picture header: INTERPFRM (1 bit, if FINTERPFLAG is set),
+	 * FRMCNT (2), RANGEREDFRM (1, if RANGERED is set), PTYPE */
+	if (!gst_vmeta_bit_reader_skip(&reader, (parser->vc1m_finterpflag ? 1 : 0) + 2 + (parser->vc1m_rangered ? 1 : 0)))
+		return FALSE;
+
+	if (!gst_vmeta_bit_reader_read(&reader, 1, &bits))
+		return FALSE;
+
+	/* Without B-frames, PTYPE is 0 = I, 1 = P; otherwise, it is 1 = P, 01 = I, 00 = B/BI */
+	if (parser->vc1m_maxbframes == 0)
+	{
+		*flags = (bits == 0) ? (GST_VMETA_PICTURE_FLAG_KEY | GST_VMETA_PICTURE_FLAG_REFERENCE) : GST_VMETA_PICTURE_FLAG_REFERENCE;
+		return TRUE;
+	}
+
+	if (bits == 1)
+	{
+		*flags = GST_VMETA_PICTURE_FLAG_REFERENCE;
+		return TRUE;
+	}
+
+	if (!gst_vmeta_bit_reader_read(&reader, 1, &bits))
+		return FALSE;
+	*flags = (bits == 1) ? (GST_VMETA_PICTURE_FLAG_KEY | GST_VMETA_PICTURE_FLAG_REFERENCE) : 0;
+	return TRUE;
+}
+
+
+
+
+void gst_vmeta_bitstream_parser_init(GstVmetaBitstreamParser *parser, IppVideoStreamFormat strm_fmt)
+{
+	parser->strm_fmt = strm_fmt;
+	parser->h264_nal_length_size = 0;
+	parser->vc1_interlace = FALSE;
+	parser->vc1m_finterpflag = FALSE;
+	parser->vc1m_rangered = FALSE;
+	parser->vc1m_maxbframes = 0;
+}
+
+
+void gst_vmeta_bitstream_parser_parse_codec_data(GstVmetaBitstreamParser *parser, guint8 const *data, gsize size)
+{
+	switch (parser->strm_fmt)
+	{
+		case IPP_VIDEO_STRM_FMT_H264:
+		{
+			/* avcC: configurationVersion (always 1), profile, compatibility flags, level,
+			 * then 6 reserved bits and lengthSizeMinusOne (2 bits). Byte-stream codec_data
+			 * starts with a start code instead, so the first byte is 0 there. */
+			if ((size >= 7) && (data[0] == 1))
+				parser->h264_nal_length_size = (data[4] & 0x3) + 1;
+
+			break;
+		}
+
+		case IPP_VIDEO_STRM_FMT_VC1:
+		{
+			gsize offset;
+
+			for (offset = gst_vmeta_bitstream_find_start_code(data, size, 0); (offset + 3) < size; offset = gst_vmeta_bitstream_find_start_code(data, size, offset + 3))
+			{
+				if (data[offset + 3] == 0x0F)
+					gst_vmeta_bitstream_parse_vc1_sequence_header(parser, data + offset + 4, size - offset - 4);
+			}
+
+			break;
+		}
+
+		case IPP_VIDEO_STRM_FMT_VC1M:
+		{
+			GstVmetaBitReader reader = { data, size, 0 };
+			guint32 rangered, maxbframes, finterpflag;
+
+			/* STRUCT_C: 24 bits of flags which do not matter here, then RANGERED (1 bit),
+			 * MAXBFRAMES (3), QUANTIZER (2), FINTERPFLAG (1) */
+			if (gst_vmeta_bit_reader_skip(&reader, 24)
+			 && gst_vmeta_bit_reader_read(&reader, 1, &rangered)
+			 && gst_vmeta_bit_reader_read(&reader, 3, &maxbframes)
+			 && gst_vmeta_bit_reader_skip(&reader, 2)
+			 && gst_vmeta_bit_reader_read(&reader, 1, &finterpflag))
+			{
+				parser->vc1m_rangered = rangered;
+				parser->vc1m_maxbframes = maxbframes;
+				parser->vc1m_finterpflag = finterpflag;
+			}
+
+			break;
+		}
+
+		default:
+			break;
+	}
+}
+
+
+gboolean gst_vmeta_bitstream_parser_get_picture_flags(GstVmetaBitstreamParser *parser, guint8 const *data, gsize size, GstVmetaPictureFlags *flags)
+{
+	switch (parser->strm_fmt)
+	{
+		case IPP_VIDEO_STRM_FMT_H264:
+			return gst_vmeta_bitstream_get_h264_flags(parser, data, size, flags);
+		case IPP_VIDEO_STRM_FMT_MPG1:
+		case IPP_VIDEO_STRM_FMT_MPG2:
+			return gst_vmeta_bitstream_get_mpeg2_flags(data, size, flags);
+		case IPP_VIDEO_STRM_FMT_MPG4:
+			return gst_vmeta_bitstream_get_mpeg4_flags(data, size, flags);
+		case IPP_VIDEO_STRM_FMT_VC1:
+			return gst_vmeta_bitstream_get_vc1_flags(parser, data, size, flags);
+		case IPP_VIDEO_STRM_FMT_VC1M:
+			return gst_vmeta_bitstream_get_vc1m_flags(parser, data, size, flags);
+		case IPP_VIDEO_STRM_FMT_MJPG:
+			/* Every JPEG picture stands on its own */
+			*flags = GST_VMETA_PICTURE_FLAG_KEY;
+			return TRUE;
+		default:
+			return FALSE;
+	}
+}
+
+
+gsize gst_vmeta_bitstream_find_start_code(guint8 const *data, gsize size, gsize offset)
+{
+	guint32 word;
+
+	/* A start code begins with a zero byte, and in coded data, zero bytes are rare, so the data is
+	 * scanned four bytes at a time, and words without a zero byte are skipped right away (the
+	 * check sets the top bit of every byte which is zero). The word is read with memcpy, which
+	 * compiles to a plain load, and does not require any alignment. A start code which begins in
+	 * the last bytes of a word is found when that word is checked, since the byte checks may read
+	 * past the word. */
+	while ((offset + sizeof(word) + 2) < size)
+	{
+		memcpy(&word, data + offset, sizeof(word));
+
+		if (((word - 0x01010101U) & ~word & 0x80808080U) != 0)
+		{
+			gsize end = offset + sizeof(word);
+
+			for (; offset < end; ++offset)
+			{
+				if ((data[offset] == 0) && (data[offset + 1] == 0) && (data[offset + 2] == 1))
+					return offset;
+			}
+		}
+		else
+			offset += sizeof(word);
+	}
+
+	for (; (offset + 2) < size; ++offset)
+	{
+		if ((data[offset] == 0) && (data[offset + 1] == 0) && (data[offset + 2] == 1))
+			return offset;
+	}
+
+	return size;
+}
+
+
+guint8* gst_vmeta_bitstream_h264_avcc_to_byte_stream(guint8 const *data, gsize size, gsize *out_size)
+{
+	static guint8 const start_code[4] = { 0, 0, 0, 1 };
+	guint8 *out_data = NULL;
+	gsize offset, out_offset = 0;
+	guint pass, set, num_nals, i;
+
+	/* avcC: 5 bytes of profile, level, and length size information, then the number of SPS
+	 * (lower 5 bits) and the SPS, followed by the number of PPS and the PPS; each NAL unit is
+	 * preceded by its 16-bit length. The first pass validates the data and determines the
+	 * output size, the second pass writes the NAL units. */
+	if ((size < 7) || (data[0] != 1))
+		return NULL;
+
+	for (pass = 0; pass < 2; ++pass)
+	{
+		offset = 5;
+		out_offset = 0;
+
+		for (set = 0; set < 2; ++set)
+		{
+			if (offset >= size)
+				goto invalid;
+
+			num_nals = (set == 0) ? (data[offset] & 0x1f) : data[offset];
+			++offset;
+
+			for (i = 0; i < num_nals; ++i)
+			{
+				gsize nal_size;
+
+				if ((offset + 2) > size)
+					goto invalid;
+				nal_size = (data[offset] << 8) | data[offset + 1];
+				offset += 2;
+				if ((offset + nal_size) > size)
+					goto invalid;
+
+				if (out_data != NULL)
+				{
+					memcpy(out_data + out_offset, start_code, sizeof(start_code));
+					memcpy(out_data + out_offset + sizeof(start_code), data + offset, nal_size);
+				}
+
+				out_offset += sizeof(start_code) + nal_size;
+				offset += nal_size;
+			}
+		}
+
+		if (pass == 0)
+			out_data = g_malloc(MAX(out_offset, 1));
+	}
+
+	*out_size = out_offset;
+	return out_data;
+
+invalid:
+	g_free(out_data);
+	return NULL;
+}
+
+
+GstVmetaUnitFlags gst_vmeta_bitstream_get_unit_flags(IppVideoStreamFormat strm_fmt, guint8 const *data, gsize size)
+{
+	guint code;
+
+	if (size < 1)
+		return 0;
+
+	code = data[0];
+
+	switch (strm_fmt)
+	{
+		case IPP_VIDEO_STRM_FMT_H264:
+		{
+			guint nal_type = code & 0x1f;
+
+			switch (nal_type)
+			{
+				case 1: /* non-IDR slice */
+				case 2: /* slice data partition A */
+				case 3: /* slice data partition B */
+				case 4: /* slice data partition C */
+				case 5: /* IDR slice */
+				{
+					GstVmetaUnitFlags flags = GST_VMETA_UNIT_FLAG_PICTURE;
+
+					/* The first slice of a picture has first_mb_in_slice = 0, which is coded as
+					 * the single bit 1. (Streams with arbitrary slice order are not detected.)
+					 * Partitions B and C always follow partition A of the same slice. */
+					if (((nal_type <= 2) || (nal_type == 5)) && (size >= 2) && ((data[1] & 0x80) != 0))
+						flags |= GST_VMETA_UNIT_FLAG_AU_START;
+					if (nal_type == 5)
+						flags |= GST_VMETA_UNIT_FLAG_KEY;
+
+					return flags;
+				}
+				case 6: /* SEI */
+				case 7: /* SPS */
+				case 8: /* PPS */
+				case 9: /* access unit delimiter */
+				case 14: case 15: case 16: case 17: case 18:
+					return GST_VMETA_UNIT_FLAG_AU_START;
+				default:
+					return 0;
+			}
+		}
+
+		case IPP_VIDEO_STRM_FMT_MPG1:
+		case IPP_VIDEO_STRM_FMT_MPG2:
+			switch (code)
+			{
+				case 0x00: /* picture; picture_coding_type follows the 10-bit temporal_reference */
+					if ((size >= 3) && (((data[2] >> 3) & 0x7) == 1))
+						return GST_VMETA_UNIT_FLAG_AU_START | GST_VMETA_UNIT_FLAG_PICTURE | GST_VMETA_UNIT_FLAG_KEY;
+					return GST_VMETA_UNIT_FLAG_AU_START | GST_VMETA_UNIT_FLAG_PICTURE;
+				case 0xB3: /* sequence header */
+				case 0xB8: /* GOP */
+					return GST_VMETA_UNIT_FLAG_AU_START;
+				default:
+					return 0;
+			}
+
+		case IPP_VIDEO_STRM_FMT_MPG4:
+			if (code == 0xB6) /* VOP; vop_coding_type is in the first 2 bits */
+			{
+				if ((size >= 2) && ((data[1] >> 6) == 0))
+					return GST_VMETA_UNIT_FLAG_AU_START | GST_VMETA_UNIT_FLAG_PICTURE | GST_VMETA_UNIT_FLAG_KEY;
+				return GST_VMETA_UNIT_FLAG_AU_START | GST_VMETA_UNIT_FLAG_PICTURE;
+			}
+			/* visual object sequence, visual object, video object layer, GOV */
+			if ((code == 0xB0) || (code == 0xB5) || (code <= 0x2F) || (code == 0xB3))
+				return GST_VMETA_UNIT_FLAG_AU_START;
+			return 0;
+
+		case IPP_VIDEO_STRM_FMT_VC1:
+			switch (code)
+			{
+				case 0x0D: /* frame */
+					return GST_VMETA_UNIT_FLAG_AU_START | GST_VMETA_UNIT_FLAG_PICTURE;
+				case 0x0F: /* sequence header */
+				case 0x0E: /* entry point */
+					return GST_VMETA_UNIT_FLAG_AU_START | GST_VMETA_UNIT_FLAG_KEY;
+				case 0x1F: /* sequence level user data */
+				case 0x1E: /* entry point level user data */
+				case 0x1D: /* frame level user data */
+					return GST_VMETA_UNIT_FLAG_AU_START;
+				default:
+					return 0;
+			}
+
+		default:
+			return 0;
+	}
+}
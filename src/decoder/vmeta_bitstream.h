@@ -0,0 +1,106 @@
+/* vMeta video decoder plugin - bitstream inspection
+ * Copyright (C) 2013  Carlos Rafael Giani
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+
+#ifndef VMETA_BITSTREAM_H
+#define VMETA_BITSTREAM_H
+
+#include <glib.h>
+
+#include <codecVC.h>
+
+
+G_BEGIN_DECLS
+
+
+/* Properties of a coded picture which matter for skipping it without decoding */
+typedef enum
+{
+	/* The picture is intra coded, and decoding can (re)start with it */
+	GST_VMETA_PICTURE_FLAG_KEY       = (1 << 0),
+	/* Other pictures may be predicted from this one, so it cannot be skipped
+	 * without corrupting the following pictures */
+	GST_VMETA_PICTURE_FLAG_REFERENCE = (1 << 1)
+}
+GstVmetaPictureFlags;
+
+
+/* Properties of a unit (an h.264 NAL unit, or a header, picture, or slice following a
+ * start code in the other formats) which matter for assembling access units */
+typedef enum
+{
+	/* The unit begins a new access unit if the current one already contains a picture */
+	GST_VMETA_UNIT_FLAG_AU_START = (1 << 0),
+	/* The unit contains (the beginning of) a picture */
+	GST_VMETA_UNIT_FLAG_PICTURE  = (1 << 1),
+	/* Decoding can (re)start with the access unit containing the unit */
+	GST_VMETA_UNIT_FLAG_KEY      = (1 << 2)
+}
+GstVmetaUnitFlags;
+
+/* Number of bytes after the 00 00 01 start code prefix which gst_vmeta_bitstream_get_unit_flags() looks at */
+#define GST_VMETA_BITSTREAM_UNIT_HEADER_SIZE 3
+
+
+/* Keeps the sequence-level information which is necessary for parsing picture headers
+ * (VC-1 picture headers depend on sequence header flags, and h.264 NAL units are
+ * either separated by start codes or prefixed with their length) */
+typedef struct
+{
+	IppVideoStreamFormat strm_fmt;
+
+	/* Size of the NAL unit length prefixes in h.264 avc streams (1-4),
+	 * or 0 if the NAL units are separated by start codes (byte-stream) */
+	guint h264_nal_length_size;
+
+	gboolean vc1_interlace;
+	gboolean vc1m_finterpflag, vc1m_rangered;
+	guint vc1m_maxbframes;
+}
+GstVmetaBitstreamParser;
+
+
+void gst_vmeta_bitstream_parser_init(GstVmetaBitstreamParser *parser, IppVideoStreamFormat strm_fmt);
+
+/* Reads sequence-level information from codec_data (WMV3/VC-1, and avcC for h.264) */
+void gst_vmeta_bitstream_parser_parse_codec_data(GstVmetaBitstreamParser *parser, guint8 const *data, gsize size);
+
+/* Determines the flags of the picture in the access unit; returns FALSE if the picture
+ * type could not be determined. Sequence headers found in the data are picked up as well. */
+gboolean gst_vmeta_bitstream_parser_get_picture_flags(GstVmetaBitstreamParser *parser, guint8 const *data, gsize size, GstVmetaPictureFlags *flags);
+
+/* Returns the offset of the next 00 00 01 start code prefix at or after the given offset,
+ * or size if there is none. The data is examined a word at a time; only words containing
+ * a zero byte are looked at more closely. */
+gsize gst_vmeta_bitstream_find_start_code(guint8 const *data, gsize size, gsize offset);
+
+/* Converts the SPS and PPS NAL units in avcC codec_data to byte-stream format (each one
+ * preceded by a start code); returns a newly allocated block, or NULL if the avcC data
+ * is invalid. The block must be freed with g_free(). */
+guint8* gst_vmeta_bitstream_h264_avcc_to_byte_stream(guint8 const *data, gsize size, gsize *out_size);
+
+/* Determines the flags of a unit; data starts right after the start code prefix (for h.264,
+ * at the NAL header), and should contain GST_VMETA_BITSTREAM_UNIT_HEADER_SIZE bytes. For
+ * h.264, the access unit boundaries follow section 7.4.1.2.3 of the specification. */
+GstVmetaUnitFlags gst_vmeta_bitstream_get_unit_flags(IppVideoStreamFormat strm_fmt, guint8 const *data, gsize size);
+
+
+G_END_DECLS
+
+
+#endif
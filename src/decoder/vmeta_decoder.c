@@ -18,9 +18,13 @@
 
 
 #include <config.h>
+#include <stdlib.h>
 #include <string.h>
 #include <gst/video/gstvideometa.h>
 #include <gst/video/gstvideopool.h>
+#ifdef HAVE_VMETA_DMABUF_EXPORT
+#include <gst/allocators/gstdmabuf.h>
+#endif
 #include <vdec_os_api.h>
 #include <misc.h>
 #include "vmeta_decoder.h"
@@ -60,17 +64,16 @@
  * This makes sure the decoder does not have to memcpy decoded frames when pushing them downstream.
  *
  * Streams do not use a GStreamer buffer pool, since these require all buffers to be of the same size, which cannot
- * be guaranteed for streams. instead, they are stored in three GLists. The first, "streams" always contains pointers
- * to all streams. It is iterated over to deallocate all streams during shutdown. The second, "streams_available",
- * contains all streams that can be used to fill in input data. The third, "streams_ready", contains all
- * streams which can be pushed to the video engine (they have been previously filled with input data).
- * 
- * TODO: Limit the picture buffer pool size.
+ * be guaranteed for streams. instead, they are kept in an array and two queues. The array, "streams" always contains
+ * pointers to all streams. It is iterated over to deallocate all streams during shutdown. The first queue,
+ * "streams_available", contains all streams that can be used to fill in input data. The second, "streams_ready",
+ * contains all streams which can be pushed to the video engine (they have been previously filled with input data).
  */
 
 
 
 GST_DEBUG_CATEGORY_STATIC(vmetadec_debug);
+GST_DEBUG_CATEGORY_STATIC(GST_CAT_PERFORMANCE);
 #define GST_CAT_DEFAULT vmetadec_debug
 
 
@@ -82,10 +85,75 @@ GST_DEBUG_CATEGORY_STATIC(vmetadec_debug);
 #define PADDED_SIZE(x) ALIGN_VAL_TO((x), 128)
 #define PADDING_LEN(x) ALIGN_OFFSET((x), 128)
 #define PADDING_BYTE 0x88          /* the vmeta decoder needs a padding of 0x88 at the end of a frame */
-#define NUM_STREAMS 7
 #define STREAM_VDECBUF_SIZE (512 * 1024U)     /* must equal to or greater than 64k and multiple of 128 */
+#define STREAM_VDECBUF_ALIGN 65536            /* stream DMA buffer sizes are aligned to 64kB boundaries */
+#define STREAM_SIZE_PERCENTILE 95             /* percentile of the recent access unit sizes the streams are sized for */
+#define STREAM_SIZE_UPDATE_INTERVAL 16        /* number of access units between stream size updates */
+#define STREAM_SHRINK_FACTOR 2                /* streams are shrunk once they are this many times larger than necessary */
+#define QOS_DEFAULT_FRAME_DURATION (40 * GST_MSECOND)  /* used for QoS decisions if frames have no duration */
+#define QOS_KEYFRAMES_ONLY_LATENESS 2         /* lateness (in frame durations) at which only keyframes are decoded */
+#define NUM_HELD_PICTURES 1                   /* number of extra pictures held back for the next frame */
+#define UNIT_CONTEXT_SIZE (3 + GST_VMETA_BITSTREAM_UNIT_HEADER_SIZE)  /* bytes needed to evaluate a start code in unparsed input */
+#define WAIT_MIN_SLEEP_US 100                 /* first sleep when waiting for the engine without a completion event */
+#define WAIT_MAX_SLEEP_US 2000                /* upper bound for the sleeps; doubled with every consecutive wait until then */
+
+#define DEFAULT_DECODE_THREAD FALSE
+#define DEFAULT_MAX_STREAMS 7
+#define DEFAULT_MIN_STREAM_SIZE (64 * 1024U)
+#define DEFAULT_MAX_STREAM_SIZE (4 * 1024 * 1024U)
+#define DEFAULT_EXTRA_OUTPUT_BUFFERS 3
+#define DEFAULT_LOW_LATENCY FALSE
+#define DEFAULT_PRIORITY 0
+#define DEFAULT_REVERSE_CACHE_BUDGET (96 * 1024 * 1024U)
+#define DEFAULT_DECODE_TIMEOUT 1000
+#define DEFAULT_INPUT_QUEUE_DEPTH 2
+#define DEFAULT_EXPORT_DMABUF FALSE
+
+#ifndef GST_CAPS_FEATURE_MEMORY_DMABUF
+#define GST_CAPS_FEATURE_MEMORY_DMABUF "memory:DMABuf"
+#endif
+
+/* Returned by the decode loop if the video engine hung; the streaming thread then reinitializes the decoder */
+#define GST_VMETA_DEC_FLOW_HANG GST_FLOW_CUSTOM_ERROR
+
+
+
+/* State of the length prefix to start code conversion of avc input data;
+ * kept across the memory blocks of an input buffer */
+typedef struct
+{
+	/* 0 if the data is copied unchanged */
+	guint nal_length_size;
+	/* Number of prefix bytes read so far, and the remaining bytes of the current NAL unit */
+	guint prefix_pos;
+	gsize nal_remaining;
+}
+GstVmetaDecAvcConversion;
+
 
 
+enum
+{
+	PROP_0,
+	PROP_DECODE_THREAD,
+	PROP_MAX_STREAMS,
+	PROP_MIN_STREAM_SIZE,
+	PROP_MAX_STREAM_SIZE,
+	PROP_EXTRA_OUTPUT_BUFFERS,
+	PROP_LOW_LATENCY,
+	PROP_PRIORITY,
+	PROP_ENGINE_OCCUPANCY,
+	PROP_REVERSE_CACHE_BUDGET,
+	PROP_NUM_ERROR_RECOVERIES,
+	PROP_NUM_ENGINE_WAITS,
+	PROP_ENGINE_WAIT_TIME,
+	PROP_DECODE_TIMEOUT,
+	PROP_DECODE_CALLS_PER_PICTURE,
+	PROP_INPUT_QUEUE_DEPTH,
+	PROP_NUM_MERGED_UPLOADS,
+	PROP_EXPORT_DMABUF
+};
+
 
 
 
@@ -102,8 +170,8 @@ static GstStaticPadTemplate static_sink_template = GST_STATIC_PAD_TEMPLATE(
 		/* IPP_VIDEO_STRM_FMT_H264 */
 		"video/x-h264, "
 		"parsed = (boolean) true, "
-		"stream-format = (string) byte-stream, "
-		"alignment = (string) au, "
+		"stream-format = (string) { byte-stream, avc }, "
+		"alignment = (string) { au, nal }, "
 		"width = (int) [ 16, 2048 ], "
 		"height = (int) [ 16, 2048 ], "
 		"framerate = (fraction) [ 0, MAX ]; "
@@ -138,20 +206,43 @@ static GstStaticPadTemplate static_sink_template = GST_STATIC_PAD_TEMPLATE(
 		"width = (int) [ 16, 2048 ], "
 		"height = (int) [ 16, 2048 ], "
 		"framerate = (fraction) [ 0, MAX ]; "
+
+		/* Unparsed elementary streams; split into access units by the decoder itself */
+		"video/x-h264, "
+		"parsed = (boolean) false, "
+		"stream-format = (string) byte-stream; "
+		"video/mpeg, "
+		"parsed = (boolean) false, "
+		"systemstream = (boolean) false, "
+		"mpegversion = (int) { 1, 2, 4 }; "
+		"video/x-wmv, "
+		"parsed = (boolean) false, "
+		"wmvversion = (int) 3, "
+		"format = (string) WVC1; "
 	)
 );
 
+#define SRC_CAPS_FIELDS \
+	"format = (string) { UYVY, I420, NV12 }, " \
+	"width = (int) [ 16, 2048 ], " \
+	"height = (int) [ 16, 2048 ], " \
+	"framerate = (fraction) [ 0, MAX ]"
+
+/* Exported pictures can be mapped like regular ones, so the dma-buf caps come second */
+#ifdef HAVE_VMETA_DMABUF_EXPORT
+#define SRC_CAPS \
+	"video/x-raw, " SRC_CAPS_FIELDS "; " \
+	"video/x-raw(" GST_CAPS_FEATURE_MEMORY_DMABUF "), " SRC_CAPS_FIELDS
+#else
+#define SRC_CAPS \
+	"video/x-raw, " SRC_CAPS_FIELDS
+#endif
+
 static GstStaticPadTemplate static_src_template = GST_STATIC_PAD_TEMPLATE(
 	"src",
 	GST_PAD_SRC,
 	GST_PAD_ALWAYS,
-	GST_STATIC_CAPS(
-		"video/x-raw, "
-		"format = (string) UYVY, "
-		"width = (int) [ 16, 2048 ], "
-		"height = (int) [ 16, 2048 ], "
-		"framerate = (fraction) [ 0, MAX ]"
-	)
+	GST_STATIC_CAPS(SRC_CAPS)
 );
 
 
@@ -159,33 +250,97 @@ G_DEFINE_TYPE(GstVmetaDec, gst_vmeta_dec, GST_TYPE_VIDEO_DECODER)
 
 
 
+/* GObject functions */
+static void gst_vmeta_dec_finalize(GObject *object);
+static void gst_vmeta_dec_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec);
+static void gst_vmeta_dec_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec);
+
 /* miscellaneous */
 static gchar const * gst_vmeta_dec_strstatus(IppCodecStatus status);
 static void gst_vmeta_dec_free_decoder(GstVmetaDec *vmeta_dec);
+static gboolean gst_vmeta_dec_init_decoder(GstVmetaDec *vmeta_dec);
+static gboolean gst_vmeta_dec_send_vc1m_seq_info(GstVmetaDec *vmeta_dec, GstBuffer *codec_data, GstVideoCodecState *state);
 static gboolean gst_vmeta_dec_fill_param_set(GstVmetaDec *vmeta_dec, GstVideoCodecState *state, GstBuffer **codec_data);
+static GstVideoFormat gst_vmeta_dec_choose_output_format(GstVmetaDec *vmeta_dec);
+static GstVideoCodecState* gst_vmeta_dec_set_output_state(GstVmetaDec *vmeta_dec, guint width, guint height, GstVideoCodecState *reference);
+static void gst_vmeta_dec_estimate_dpb_size(GstVmetaDec *vmeta_dec, GstVideoCodecState *state);
+static guint gst_vmeta_dec_get_num_required_pictures(GstVmetaDec *vmeta_dec);
+static gboolean gst_vmeta_dec_stream_has_b_frames(GstVmetaDec *vmeta_dec, GstVideoCodecState *state);
+static void gst_vmeta_dec_configure_reordering(GstVmetaDec *vmeta_dec, GstVideoCodecState *state);
+static void gst_vmeta_dec_update_latency(GstVmetaDec *vmeta_dec, GstVideoCodecState *state);
+static gboolean gst_vmeta_dec_can_reuse_decoder(GstVmetaDec *vmeta_dec, IppVmetaDecParSet const *old_param_set, GstVideoCodecState *state);
+static gboolean gst_vmeta_dec_can_reuse_pool(GstBufferPool *pool, guint size, guint min, guint max, guint *pool_size, guint *pool_min, guint *pool_max);
 static gboolean gst_vmeta_dec_suspend_and_resume(GstVmetaDec *vmeta_dec);
 static gboolean gst_vmeta_dec_suspend(GstVmetaDec *vmeta_dec, gboolean suspend);
 
-/* list helper function */
-static void gst_vmeta_dec_push_to_list(GList **list, gpointer data);
-static gpointer gst_vmeta_dec_pop_from_list(GList **list);
-
 /* stream buffer functions */
-static gboolean gst_vmeta_dec_copy_to_stream(GstVmetaDec *vmeta_dececoder, IppVmetaBitstream *stream, guint8 *in_data, gsize in_size);
+static guint gst_vmeta_dec_get_stream_prefix_size(GstVmetaDec *vmeta_dec, guint8 const *in_data, gsize in_size, gboolean *add_vc1_code);
+static void gst_vmeta_dec_write_stream_prefix(GstVmetaDec *vmeta_dec, guint8 *dest, gboolean add_vc1_code);
+static int gst_vmeta_dec_compare_sizes(void const *first, void const *second);
+static void gst_vmeta_dec_set_stream_size(GstVmetaDec *vmeta_dec, guint size);
+static void gst_vmeta_dec_init_stream_size(GstVmetaDec *vmeta_dec, GstVideoCodecState *state);
+static void gst_vmeta_dec_record_au_size(GstVmetaDec *vmeta_dec, guint au_size);
+static IppVmetaBitstream* gst_vmeta_dec_create_stream(GstVmetaDec *vmeta_dec);
+static gsize gst_vmeta_dec_get_avc_stream_size(GstVmetaDec *vmeta_dec, GstBuffer *input_buffer);
+static gsize gst_vmeta_dec_convert_input_data(GstVmetaDecAvcConversion *conversion, guint8 const *src, gsize size, guint8 *dest);
+static gboolean gst_vmeta_dec_copy_memories(GstVmetaDec *vmeta_dec, GstBuffer *input_buffer, guint8 *dest, gsize *copied_size);
+static gboolean gst_vmeta_dec_copy_to_stream(GstVmetaDec *vmeta_dec, IppVmetaBitstream *stream, GstBuffer *input_buffer);
+static gboolean gst_vmeta_dec_wrap_input_buffer(GstVmetaDec *vmeta_dec, IppVmetaBitstream *stream, GstBuffer *input_buffer);
+static void gst_vmeta_dec_clear_stream(IppVmetaBitstream *stream);
+static GstFlowReturn gst_vmeta_dec_acquire_stream(GstVmetaDec *vmeta_dec, IppVmetaBitstream **stream);
+static void gst_vmeta_dec_release_stream(GstVmetaDec *vmeta_dec, IppVmetaBitstream *stream, gboolean ready);
+static IppVmetaBitstream* gst_vmeta_dec_pop_ready_stream(GstVmetaDec *vmeta_dec);
+static gboolean gst_vmeta_dec_push_stream(GstVmetaDec *vmeta_dec, IppVmetaBitstream *stream);
+static GstFlowReturn gst_vmeta_dec_push_queued_streams(GstVmetaDec *vmeta_dec, guint input_queue_depth);
 static gboolean gst_vmeta_dec_return_stream_buffers(GstVmetaDec *vmeta_dec);
 
 /* picture buffer functions */
 static gboolean gst_vmeta_dec_return_picture_buffers(GstVmetaDec *vmeta_dec);
 static IppVmetaPicture* gst_vmeta_dec_get_ipp_picture_from_buffer(GstVmetaDec *vmeta_decoder, GstBuffer *buffer);
 static GstBuffer* gst_vmeta_dec_get_buffer_from_ipp_picture(GstVmetaDec *vmeta_decoder, IppVmetaPicture *picture);
+static gboolean gst_vmeta_dec_crop_picture(GstVmetaDec *vmeta_dec, GstBuffer **picture_buffer);
+
+/* decoding functions */
+static GstFlowReturn gst_vmeta_dec_collect_nal_units(GstVmetaDec *vmeta_dec, GstVideoCodecFrame *frame, GstAdapter *adapter, gboolean at_eos);
+static GstFlowReturn gst_vmeta_dec_assemble_au(GstVmetaDec *vmeta_dec, GstVideoCodecFrame *frame, GstAdapter *adapter, gboolean at_eos);
+static GstFlowReturn gst_vmeta_dec_upload_frame(GstVmetaDec *vmeta_dec, GstVideoCodecFrame *frame);
+static GstFlowReturn gst_vmeta_dec_push_output_pictures(GstVmetaDec *vmeta_dec, gboolean may_block);
+static GstFlowReturn gst_vmeta_dec_output_picture(GstVmetaDec *vmeta_dec, GstBuffer *picture_buffer);
+static GstFlowReturn gst_vmeta_dec_hold_extra_picture(GstVmetaDec *vmeta_dec, GstBuffer *picture_buffer);
+static GstFlowReturn gst_vmeta_dec_output_held_picture(GstVmetaDec *vmeta_dec);
+static GstFlowReturn gst_vmeta_dec_push_held_picture(GstVmetaDec *vmeta_dec);
+static GstFlowReturn gst_vmeta_dec_push_extra_picture(GstVmetaDec *vmeta_dec, GstBuffer *picture_buffer);
+static GstFlowReturn gst_vmeta_dec_handle_new_sequence(GstVmetaDec *vmeta_dec);
+static GstFlowReturn gst_vmeta_dec_decode_loop(GstVmetaDec *vmeta_dec);
+static GstFlowReturn gst_vmeta_dec_run_decode_loop(GstVmetaDec *vmeta_dec);
+static void gst_vmeta_dec_wait_for_engine(GstVmetaDec *vmeta_dec, guint num_consecutive_waits);
+static gboolean gst_vmeta_dec_get_picture_flags(GstVmetaDec *vmeta_dec, GstVideoCodecFrame *frame, GstVmetaPictureFlags *flags);
+static gboolean gst_vmeta_dec_qos_drop_frame(GstVmetaDec *vmeta_dec, GstVideoCodecFrame *frame);
+static gboolean gst_vmeta_dec_is_keyframe(GstVmetaDec *vmeta_dec, GstVideoCodecFrame *frame);
+static GstFlowReturn gst_vmeta_dec_drain(GstVmetaDec *vmeta_dec);
+static guint gst_vmeta_dec_get_reverse_cache_size(GstVmetaDec *vmeta_dec);
+static gboolean gst_vmeta_dec_reverse_skip_frame(GstVmetaDec *vmeta_dec, GstVideoCodecFrame *frame);
+static GstFlowReturn gst_vmeta_dec_resync(GstVmetaDec *vmeta_dec, GstVideoCodecFrame *current_frame);
+static GstFlowReturn gst_vmeta_dec_recover_from_hang(GstVmetaDec *vmeta_dec, GstVideoCodecFrame *current_frame);
+static GstFlowReturn gst_vmeta_dec_recover_if_hung(GstVmetaDec *vmeta_dec, GstFlowReturn flow_ret, GstVideoCodecFrame *current_frame);
+
+/* decode thread functions */
+static gboolean gst_vmeta_dec_start_decode_thread(GstVmetaDec *vmeta_dec);
+static void gst_vmeta_dec_stop_decode_thread(GstVmetaDec *vmeta_dec, gboolean stream_locked);
+static void gst_vmeta_dec_wait_for_decode_thread(GstVmetaDec *vmeta_dec);
+static GstFlowReturn gst_vmeta_dec_wait_until_streams_decoded(GstVmetaDec *vmeta_dec);
+static gpointer gst_vmeta_dec_decode_thread_func(gpointer data);
 
 /* functions for the base class */
 static gboolean gst_vmeta_dec_start(GstVideoDecoder *decoder);
 static gboolean gst_vmeta_dec_stop(GstVideoDecoder *decoder);
 static gboolean gst_vmeta_dec_set_format(GstVideoDecoder *decoder, GstVideoCodecState *state);
+static GstFlowReturn gst_vmeta_dec_parse(GstVideoDecoder *decoder, GstVideoCodecFrame *frame, GstAdapter *adapter, gboolean at_eos);
 static GstFlowReturn gst_vmeta_dec_handle_frame(GstVideoDecoder *decoder, GstVideoCodecFrame *frame);
+static GstFlowReturn gst_vmeta_dec_finish(GstVideoDecoder *decoder);
 static gboolean gst_vmeta_dec_reset(GstVideoDecoder *decoder, gboolean hard);
 static gboolean gst_vmeta_dec_decide_allocation(GstVideoDecoder *decoder, GstQuery *query);
+static gboolean gst_vmeta_dec_propose_allocation(GstVideoDecoder *decoder, GstQuery *query);
 static GstStateChangeReturn gst_vmeta_dec_change_state(GstElement * element, GstStateChange transition);
 
 
@@ -195,14 +350,223 @@ static GstStateChangeReturn gst_vmeta_dec_change_state(GstElement * element, Gst
 
 void gst_vmeta_dec_class_init(GstVmetaDecClass *klass)
 {
+	GObjectClass *object_class;
 	GstVideoDecoderClass *base_class;
 	GstElementClass *element_class;
 
 	GST_DEBUG_CATEGORY_INIT(vmetadec_debug, "vmetadec", 0, "Marvell vMeta video decoder");
+	GST_DEBUG_CATEGORY_GET(GST_CAT_PERFORMANCE, "GST_PERFORMANCE");
 
+	object_class = G_OBJECT_CLASS(klass);
 	base_class = GST_VIDEO_DECODER_CLASS(klass);
 	element_class = GST_ELEMENT_CLASS(klass);
 
+	object_class->finalize     = GST_DEBUG_FUNCPTR(gst_vmeta_dec_finalize);
+	object_class->set_property = GST_DEBUG_FUNCPTR(gst_vmeta_dec_set_property);
+	object_class->get_property = GST_DEBUG_FUNCPTR(gst_vmeta_dec_get_property);
+
+	g_object_class_install_property(
+		object_class,
+		PROP_DECODE_THREAD,
+		g_param_spec_boolean(
+			"decode-thread",
+			"Decode thread",
+			"Drive the video engine from a separate thread, so upstream can prepare the next frame while the current one is decoded (takes effect when the element is started)",
+			DEFAULT_DECODE_THREAD,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_MAX_STREAMS,
+		g_param_spec_uint(
+			"max-streams",
+			"Maximum number of streams",
+			"Maximum number of stream buffers for input data; streams are allocated on demand (takes effect when the element is started)",
+			2, 64,
+			DEFAULT_MAX_STREAMS,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_MIN_STREAM_SIZE,
+		g_param_spec_uint(
+			"min-stream-size",
+			"Minimum stream size",
+			"Minimum size of stream DMA buffers, in bytes",
+			STREAM_VDECBUF_ALIGN, G_MAXINT,
+			DEFAULT_MIN_STREAM_SIZE,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_MAX_STREAM_SIZE,
+		g_param_spec_uint(
+			"max-stream-size",
+			"Maximum stream size",
+			"Maximum size stream DMA buffers are provisioned with, in bytes; larger access units still get a sufficiently large stream",
+			STREAM_VDECBUF_ALIGN, G_MAXINT,
+			DEFAULT_MAX_STREAM_SIZE,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_EXTRA_OUTPUT_BUFFERS,
+		g_param_spec_uint(
+			"extra-output-buffers",
+			"Extra output buffers",
+			"Number of output pictures allocated in addition to the ones required by the video engine, for use by downstream (takes effect when the output is negotiated)",
+			0, 32,
+			DEFAULT_EXTRA_OUTPUT_BUFFERS,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_LOW_LATENCY,
+		g_param_spec_boolean(
+			"low-latency",
+			"Low latency",
+			"Disable picture reordering for streams which cannot contain B-frames, so pictures are output as soon as they are decoded (takes effect when the format is set)",
+			DEFAULT_LOW_LATENCY,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_PRIORITY,
+		g_param_spec_int(
+			"priority",
+			"Priority",
+			"Priority for accessing the video engine if several decoders in this process share it; higher values are preferred",
+			G_MININT, G_MAXINT,
+			DEFAULT_PRIORITY,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_ENGINE_OCCUPANCY,
+		g_param_spec_double(
+			"engine-occupancy",
+			"Engine occupancy",
+			"Fraction of the time since the decoder was started during which it held the video engine",
+			0.0, 1.0,
+			0.0,
+			G_PARAM_READABLE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_REVERSE_CACHE_BUDGET,
+		g_param_spec_uint(
+			"reverse-cache-budget",
+			"Reverse cache budget",
+			"Amount of DMA memory for the decoded pictures of a GOP during reverse playback, in bytes; if a GOP does not fit, only keyframes are decoded (takes effect when the output is negotiated)",
+			0, G_MAXINT,
+			DEFAULT_REVERSE_CACHE_BUDGET,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_NUM_ERROR_RECOVERIES,
+		g_param_spec_uint(
+			"num-error-recoveries",
+			"Number of error recoveries",
+			"Number of times decoding was resumed at a keyframe after a bitstream error",
+			0, G_MAXUINT,
+			0,
+			G_PARAM_READABLE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_NUM_ENGINE_WAITS,
+		g_param_spec_uint64(
+			"num-engine-waits",
+			"Number of engine waits",
+			"Number of times the decoder waited for the video engine to finish decoding",
+			0, G_MAXUINT64,
+			0,
+			G_PARAM_READABLE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_ENGINE_WAIT_TIME,
+		g_param_spec_uint64(
+			"engine-wait-time",
+			"Engine wait time",
+			"Total time the decoder waited for the video engine to finish decoding, in nanoseconds",
+			0, G_MAXUINT64,
+			0,
+			G_PARAM_READABLE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_DECODE_TIMEOUT,
+		g_param_spec_uint(
+			"decode-timeout",
+			"Decode timeout",
+			"Time in milliseconds the video engine may take for a frame before it is considered hung and gets reinitialized (0 = never)",
+			0, G_MAXUINT,
+			DEFAULT_DECODE_TIMEOUT,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_DECODE_CALLS_PER_PICTURE,
+		g_param_spec_double(
+			"decode-calls-per-picture",
+			"Decode calls per picture",
+			"Average number of DecodeFrame_Vmeta() calls per output picture since the decoder was started",
+			0.0, G_MAXDOUBLE,
+			0.0,
+			G_PARAM_READABLE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_INPUT_QUEUE_DEPTH,
+		g_param_spec_uint(
+			"input-queue-depth",
+			"Input queue depth",
+			"Maximum number of streams handed to the video engine ahead of time in decode thread mode (1 = only when the engine asks for input)",
+			1, 64,
+			DEFAULT_INPUT_QUEUE_DEPTH,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_NUM_MERGED_UPLOADS,
+		g_param_spec_uint(
+			"num-merged-uploads",
+			"Number of merged uploads",
+			"Number of multi-memory input buffers which had to be merged into a temporary buffer before they could be copied",
+			0, G_MAXUINT,
+			0,
+			G_PARAM_READABLE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_EXPORT_DMABUF,
+		g_param_spec_boolean(
+			"export-dmabuf",
+			"Export dma-bufs",
+			"Output pictures in dma-buf memory, so other devices and processes can access them without copies (takes effect at the next allocation)",
+			DEFAULT_EXPORT_DMABUF,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+
 	gst_element_class_set_static_metadata(
 		element_class,
 		"vMeta video decoder",
@@ -214,13 +578,16 @@ void gst_vmeta_dec_class_init(GstVmetaDecClass *klass)
 	gst_element_class_add_pad_template(element_class, gst_static_pad_template_get(&static_sink_template));
 	gst_element_class_add_pad_template(element_class, gst_static_pad_template_get(&static_src_template));
 
-	base_class->start             = GST_DEBUG_FUNCPTR(gst_vmeta_dec_start);
-	base_class->stop              = GST_DEBUG_FUNCPTR(gst_vmeta_dec_stop);
-	base_class->set_format        = GST_DEBUG_FUNCPTR(gst_vmeta_dec_set_format);
-	base_class->handle_frame      = GST_DEBUG_FUNCPTR(gst_vmeta_dec_handle_frame);
-	base_class->reset             = GST_DEBUG_FUNCPTR(gst_vmeta_dec_reset);
-	base_class->decide_allocation = GST_DEBUG_FUNCPTR(gst_vmeta_dec_decide_allocation);
-	element_class->change_state   = GST_DEBUG_FUNCPTR(gst_vmeta_dec_change_state);
+	base_class->start              = GST_DEBUG_FUNCPTR(gst_vmeta_dec_start);
+	base_class->stop               = GST_DEBUG_FUNCPTR(gst_vmeta_dec_stop);
+	base_class->set_format         = GST_DEBUG_FUNCPTR(gst_vmeta_dec_set_format);
+	base_class->parse              = GST_DEBUG_FUNCPTR(gst_vmeta_dec_parse);
+	base_class->handle_frame       = GST_DEBUG_FUNCPTR(gst_vmeta_dec_handle_frame);
+	base_class->finish             = GST_DEBUG_FUNCPTR(gst_vmeta_dec_finish);
+	base_class->reset              = GST_DEBUG_FUNCPTR(gst_vmeta_dec_reset);
+	base_class->decide_allocation  = GST_DEBUG_FUNCPTR(gst_vmeta_dec_decide_allocation);
+	base_class->propose_allocation = GST_DEBUG_FUNCPTR(gst_vmeta_dec_propose_allocation);
+	element_class->change_state    = GST_DEBUG_FUNCPTR(gst_vmeta_dec_change_state);
 }
 
 
@@ -230,13 +597,276 @@ void gst_vmeta_dec_init(GstVmetaDec *vmeta_dec)
 	vmeta_dec->dec_state = NULL;
 	vmeta_dec->is_suspended = FALSE;
 
+	vmeta_dec->scheduler_client = NULL;
+	vmeta_dec->priority = DEFAULT_PRIORITY;
+
 	vmeta_dec->streams = NULL;
-	vmeta_dec->streams_available = NULL;
-	vmeta_dec->streams_ready = NULL;
+	vmeta_dec->num_streams = 0;
+	memset(&(vmeta_dec->streams_available), 0, sizeof(GstVmetaDecStreamQueue));
+	memset(&(vmeta_dec->streams_ready), 0, sizeof(GstVmetaDecStreamQueue));
+	g_mutex_init(&(vmeta_dec->streams_mutex));
+	g_cond_init(&(vmeta_dec->streams_cond));
+
+	vmeta_dec->max_streams = DEFAULT_MAX_STREAMS;
+	vmeta_dec->min_stream_size = DEFAULT_MIN_STREAM_SIZE;
+	vmeta_dec->max_stream_size = DEFAULT_MAX_STREAM_SIZE;
+	vmeta_dec->stream_size = STREAM_VDECBUF_SIZE;
+	vmeta_dec->au_size_history_pos = 0;
+	vmeta_dec->au_size_history_length = 0;
+	vmeta_dec->num_au_sizes_since_update = 0;
+
+	vmeta_dec->extra_output_buffers = DEFAULT_EXTRA_OUTPUT_BUFFERS;
+	vmeta_dec->export_dmabuf = DEFAULT_EXPORT_DMABUF;
+	vmeta_dec->dpb_size = 0;
+	vmeta_dec->low_latency = DEFAULT_LOW_LATENCY;
 
 	vmeta_dec->upload_before_loop = FALSE;
+	vmeta_dec->num_expected_pictures = 0;
+	vmeta_dec->num_engine_pictures = 0;
+	vmeta_dec->input_queue_depth = DEFAULT_INPUT_QUEUE_DEPTH;
+	vmeta_dec->num_engine_streams = 0;
+	vmeta_dec->held_picture = NULL;
+	vmeta_dec->frames_finished = FALSE;
+	vmeta_dec->last_output_pts = GST_CLOCK_TIME_NONE;
+	vmeta_dec->last_output_duration = GST_CLOCK_TIME_NONE;
+
+	vmeta_dec->decode_thread_enabled = DEFAULT_DECODE_THREAD;
+	vmeta_dec->use_decode_thread = FALSE;
+	vmeta_dec->decode_thread = NULL;
+	vmeta_dec->decode_thread_stop = FALSE;
+	vmeta_dec->decode_thread_idle = TRUE;
+	vmeta_dec->decode_thread_flow_ret = GST_FLOW_OK;
 
 	vmeta_dec->codec_data = NULL;
+	vmeta_dec->sequence_codec_data = NULL;
+	vmeta_dec->input_state = NULL;
+	vmeta_dec->output_format = GST_VIDEO_FORMAT_UYVY;
+	vmeta_dec->downstream_video_meta = FALSE;
+	vmeta_dec->downstream_crop_meta = FALSE;
+
+	gst_vmeta_bitstream_parser_init(&(vmeta_dec->bitstream_parser), IPP_VIDEO_STRM_FMT_H264);
+	vmeta_dec->nal_alignment = FALSE;
+	vmeta_dec->unparsed_input = FALSE;
+	vmeta_dec->au_has_picture = FALSE;
+	vmeta_dec->qos_keyframes_only = FALSE;
+
+	vmeta_dec->reverse_cache_budget = DEFAULT_REVERSE_CACHE_BUDGET;
+	vmeta_dec->reverse_playback = FALSE;
+	vmeta_dec->reverse_keyframes_only = FALSE;
+	vmeta_dec->reverse_gop_length = 0;
+	vmeta_dec->reverse_last_gop_length = 0;
+	vmeta_dec->reverse_num_cached = 0;
+
+	vmeta_dec->error_recovery = FALSE;
+	vmeta_dec->qos_resync = FALSE;
+	vmeta_dec->num_error_recoveries = 0;
+
+	vmeta_dec->num_engine_waits = 0;
+	vmeta_dec->engine_wait_time = 0;
+	vmeta_dec->num_decode_calls = 0;
+	vmeta_dec->num_output_pictures = 0;
+	vmeta_dec->num_merged_uploads = 0;
+
+	vmeta_dec->decode_timeout = DEFAULT_DECODE_TIMEOUT;
+	vmeta_dec->hang_stall_time = 0;
+	vmeta_dec->num_hang_recoveries = 0;
+}
+
+
+
+
+/*********************/
+/* GObject functions */
+
+static void gst_vmeta_dec_finalize(GObject *object)
+{
+	GstVmetaDec *vmeta_dec = GST_VMETA_DEC(object);
+
+	g_mutex_clear(&(vmeta_dec->streams_mutex));
+	g_cond_clear(&(vmeta_dec->streams_cond));
+
+	G_OBJECT_CLASS(gst_vmeta_dec_parent_class)->finalize(object);
+}
+
+
+static void gst_vmeta_dec_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec)
+{
+	GstVmetaDec *vmeta_dec = GST_VMETA_DEC(object);
+
+	switch (prop_id)
+	{
+		case PROP_DECODE_THREAD:
+			GST_OBJECT_LOCK(vmeta_dec);
+			vmeta_dec->decode_thread_enabled = g_value_get_boolean(value);
+			GST_OBJECT_UNLOCK(vmeta_dec);
+			break;
+		case PROP_MAX_STREAMS:
+			GST_OBJECT_LOCK(vmeta_dec);
+			vmeta_dec->max_streams = g_value_get_uint(value);
+			GST_OBJECT_UNLOCK(vmeta_dec);
+			break;
+		case PROP_MIN_STREAM_SIZE:
+			GST_OBJECT_LOCK(vmeta_dec);
+			vmeta_dec->min_stream_size = g_value_get_uint(value);
+			GST_OBJECT_UNLOCK(vmeta_dec);
+			break;
+		case PROP_MAX_STREAM_SIZE:
+			GST_OBJECT_LOCK(vmeta_dec);
+			vmeta_dec->max_stream_size = g_value_get_uint(value);
+			GST_OBJECT_UNLOCK(vmeta_dec);
+			break;
+		case PROP_EXTRA_OUTPUT_BUFFERS:
+			GST_OBJECT_LOCK(vmeta_dec);
+			vmeta_dec->extra_output_buffers = g_value_get_uint(value);
+			GST_OBJECT_UNLOCK(vmeta_dec);
+			break;
+		case PROP_LOW_LATENCY:
+			GST_OBJECT_LOCK(vmeta_dec);
+			vmeta_dec->low_latency = g_value_get_boolean(value);
+			GST_OBJECT_UNLOCK(vmeta_dec);
+			break;
+		case PROP_PRIORITY:
+			GST_OBJECT_LOCK(vmeta_dec);
+			vmeta_dec->priority = g_value_get_int(value);
+			if (vmeta_dec->scheduler_client != NULL)
+				gst_vmeta_scheduler_client_set_priority(vmeta_dec->scheduler_client, vmeta_dec->priority);
+			GST_OBJECT_UNLOCK(vmeta_dec);
+			break;
+		case PROP_REVERSE_CACHE_BUDGET:
+			GST_OBJECT_LOCK(vmeta_dec);
+			vmeta_dec->reverse_cache_budget = g_value_get_uint(value);
+			GST_OBJECT_UNLOCK(vmeta_dec);
+			break;
+		case PROP_DECODE_TIMEOUT:
+			GST_OBJECT_LOCK(vmeta_dec);
+			vmeta_dec->decode_timeout = g_value_get_uint(value);
+			GST_OBJECT_UNLOCK(vmeta_dec);
+			break;
+		case PROP_INPUT_QUEUE_DEPTH:
+			GST_OBJECT_LOCK(vmeta_dec);
+			vmeta_dec->input_queue_depth = g_value_get_uint(value);
+			GST_OBJECT_UNLOCK(vmeta_dec);
+			break;
+		case PROP_EXPORT_DMABUF:
+			GST_OBJECT_LOCK(vmeta_dec);
+			vmeta_dec->export_dmabuf = g_value_get_boolean(value);
+			GST_OBJECT_UNLOCK(vmeta_dec);
+			break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			break;
+	}
+}
+
+
+static void gst_vmeta_dec_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+	GstVmetaDec *vmeta_dec = GST_VMETA_DEC(object);
+
+	switch (prop_id)
+	{
+		case PROP_DECODE_THREAD:
+			GST_OBJECT_LOCK(vmeta_dec);
+			g_value_set_boolean(value, vmeta_dec->decode_thread_enabled);
+			GST_OBJECT_UNLOCK(vmeta_dec);
+			break;
+		case PROP_MAX_STREAMS:
+			GST_OBJECT_LOCK(vmeta_dec);
+			g_value_set_uint(value, vmeta_dec->max_streams);
+			GST_OBJECT_UNLOCK(vmeta_dec);
+			break;
+		case PROP_MIN_STREAM_SIZE:
+			GST_OBJECT_LOCK(vmeta_dec);
+			g_value_set_uint(value, vmeta_dec->min_stream_size);
+			GST_OBJECT_UNLOCK(vmeta_dec);
+			break;
+		case PROP_MAX_STREAM_SIZE:
+			GST_OBJECT_LOCK(vmeta_dec);
+			g_value_set_uint(value, vmeta_dec->max_stream_size);
+			GST_OBJECT_UNLOCK(vmeta_dec);
+			break;
+		case PROP_EXTRA_OUTPUT_BUFFERS:
+			GST_OBJECT_LOCK(vmeta_dec);
+			g_value_set_uint(value, vmeta_dec->extra_output_buffers);
+			GST_OBJECT_UNLOCK(vmeta_dec);
+			break;
+		case PROP_LOW_LATENCY:
+			GST_OBJECT_LOCK(vmeta_dec);
+			g_value_set_boolean(value, vmeta_dec->low_latency);
+			GST_OBJECT_UNLOCK(vmeta_dec);
+			break;
+		case PROP_PRIORITY:
+			GST_OBJECT_LOCK(vmeta_dec);
+			g_value_set_int(value, vmeta_dec->priority);
+			GST_OBJECT_UNLOCK(vmeta_dec);
+			break;
+		case PROP_ENGINE_OCCUPANCY:
+		{
+			GstVmetaSchedulerStats stats;
+
+			GST_OBJECT_LOCK(vmeta_dec);
+			if (vmeta_dec->scheduler_client != NULL)
+			{
+				gst_vmeta_scheduler_client_get_stats(vmeta_dec->scheduler_client, &stats);
+				g_value_set_double(value, stats.occupancy);
+			}
+			else
+				g_value_set_double(value, 0.0);
+			GST_OBJECT_UNLOCK(vmeta_dec);
+			break;
+		}
+		case PROP_REVERSE_CACHE_BUDGET:
+			GST_OBJECT_LOCK(vmeta_dec);
+			g_value_set_uint(value, vmeta_dec->reverse_cache_budget);
+			GST_OBJECT_UNLOCK(vmeta_dec);
+			break;
+		case PROP_NUM_ERROR_RECOVERIES:
+			GST_OBJECT_LOCK(vmeta_dec);
+			g_value_set_uint(value, vmeta_dec->num_error_recoveries);
+			GST_OBJECT_UNLOCK(vmeta_dec);
+			break;
+		case PROP_NUM_ENGINE_WAITS:
+			GST_OBJECT_LOCK(vmeta_dec);
+			g_value_set_uint64(value, vmeta_dec->num_engine_waits);
+			GST_OBJECT_UNLOCK(vmeta_dec);
+			break;
+		case PROP_ENGINE_WAIT_TIME:
+			GST_OBJECT_LOCK(vmeta_dec);
+			g_value_set_uint64(value, vmeta_dec->engine_wait_time);
+			GST_OBJECT_UNLOCK(vmeta_dec);
+			break;
+		case PROP_DECODE_TIMEOUT:
+			GST_OBJECT_LOCK(vmeta_dec);
+			g_value_set_uint(value, vmeta_dec->decode_timeout);
+			GST_OBJECT_UNLOCK(vmeta_dec);
+			break;
+		case PROP_DECODE_CALLS_PER_PICTURE:
+			GST_OBJECT_LOCK(vmeta_dec);
+			if (vmeta_dec->num_output_pictures > 0)
+				g_value_set_double(value, (gdouble)(vmeta_dec->num_decode_calls) / (gdouble)(vmeta_dec->num_output_pictures));
+			else
+				g_value_set_double(value, 0.0);
+			GST_OBJECT_UNLOCK(vmeta_dec);
+			break;
+		case PROP_INPUT_QUEUE_DEPTH:
+			GST_OBJECT_LOCK(vmeta_dec);
+			g_value_set_uint(value, vmeta_dec->input_queue_depth);
+			GST_OBJECT_UNLOCK(vmeta_dec);
+			break;
+		case PROP_NUM_MERGED_UPLOADS:
+			GST_OBJECT_LOCK(vmeta_dec);
+			g_value_set_uint(value, vmeta_dec->num_merged_uploads);
+			GST_OBJECT_UNLOCK(vmeta_dec);
+			break;
+		case PROP_EXPORT_DMABUF:
+			GST_OBJECT_LOCK(vmeta_dec);
+			g_value_set_boolean(value, vmeta_dec->export_dmabuf);
+			GST_OBJECT_UNLOCK(vmeta_dec);
+			break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			break;
+	}
 }
 
 
@@ -314,13 +944,87 @@ static void gst_vmeta_dec_free_decoder(GstVmetaDec *vmeta_dec)
 	if (vmeta_dec->dec_state == NULL)
 		return;
 
+	gst_vmeta_scheduler_acquire(vmeta_dec->scheduler_client);
 	DecodeSendCmd_Vmeta(IPPVC_STOP_DECODE_STREAM, NULL, NULL, vmeta_dec->dec_state);
+	gst_vmeta_scheduler_release(vmeta_dec->scheduler_client);
+
 	gst_vmeta_dec_reset(GST_VIDEO_DECODER(vmeta_dec), TRUE);
+
+	gst_vmeta_scheduler_acquire(vmeta_dec->scheduler_client);
 	DecoderFree_Vmeta(&(vmeta_dec->dec_state));
+	gst_vmeta_scheduler_release(vmeta_dec->scheduler_client);
+	gst_vmeta_scheduler_client_detach(vmeta_dec->scheduler_client);
+
 	vmeta_dec->dec_state = NULL;
 }
 
 
+static gboolean gst_vmeta_dec_init_decoder(GstVmetaDec *vmeta_dec)
+{
+	IppCodecStatus ret;
+
+	memset(&(vmeta_dec->dec_info), 0, sizeof(IppVmetaDecInfo));
+
+	/* The actual initialization; requires bitstream information (such as the codec type), which
+	 * is determined by gst_vmeta_dec_fill_param_set() */
+	vmeta_dec->dec_param_set.bFirstUser = gst_vmeta_scheduler_client_attach(vmeta_dec->scheduler_client) ? 1 : 0;
+	gst_vmeta_scheduler_acquire(vmeta_dec->scheduler_client);
+	ret = DecoderInitAlloc_Vmeta(&(vmeta_dec->dec_param_set), vmeta_dec->callback_table, &(vmeta_dec->dec_state));
+	gst_vmeta_scheduler_release(vmeta_dec->scheduler_client);
+	if (ret != IPP_STATUS_NOERR)
+	{
+		gst_vmeta_scheduler_client_detach(vmeta_dec->scheduler_client);
+		vmeta_dec->dec_state = NULL;
+		GST_ERROR_OBJECT(vmeta_dec, "failed to initialize&alloc vMeta state : %s", gst_vmeta_dec_strstatus(ret));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+static gboolean gst_vmeta_dec_send_vc1m_seq_info(GstVmetaDec *vmeta_dec, GstBuffer *codec_data, GstVideoCodecState *state)
+{
+	IppCodecStatus ret;
+	GstMapInfo codec_data_map;
+	unsigned char* cdata;
+	unsigned int csize;
+	vc1m_seq_header seq_header;
+
+	if (codec_data == NULL)
+	{
+		GST_ERROR_OBJECT(vmeta_dec, "WMV3/VC1-SPMP data without codec_data");
+		return FALSE;
+	}
+
+	gst_buffer_map(codec_data, &codec_data_map, GST_MAP_READ);
+	cdata = codec_data_map.data;
+	csize = codec_data_map.size;
+
+	seq_header.num_frames = 0xffffff;
+	seq_header.vert_size = state->info.height;
+	seq_header.horiz_size = state->info.width;
+	seq_header.level = ((cdata[0] >> 4) == 4) ? 4 : 2;
+	seq_header.cbr = 1;
+	seq_header.hrd_buffer = 0x007fff;
+	seq_header.hrd_rate = 0x00007fff;
+	seq_header.frame_rate = 0xffffffff;
+	memcpy(seq_header.exthdr, cdata, csize);
+	seq_header.exthdrsize = csize;
+	ret = DecodeSendCmd_Vmeta(IPPVC_SET_VC1M_SEQ_INFO, &seq_header, NULL, vmeta_dec->dec_state);
+
+	gst_buffer_unmap(codec_data, &codec_data_map);
+
+	if (ret != IPP_STATUS_NOERR)
+	{
+		GST_ERROR_OBJECT(vmeta_dec, "failed to send WMV3/VC1-SPMP seq info to decoder: %s", gst_vmeta_dec_strstatus(ret));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+
 static gboolean gst_vmeta_dec_fill_param_set(GstVmetaDec *vmeta_dec, GstVideoCodecState *state, GstBuffer **codec_data)
 {
 	guint structure_nr;
@@ -328,6 +1032,8 @@ static gboolean gst_vmeta_dec_fill_param_set(GstVmetaDec *vmeta_dec, GstVideoCod
 	gboolean do_codec_data = FALSE;
 
 	memset(&(vmeta_dec->dec_param_set), 0, sizeof(IppVmetaDecParSet));
+	vmeta_dec->nal_alignment = FALSE;
+	vmeta_dec->unparsed_input = FALSE;
 
 	for (structure_nr = 0; structure_nr < gst_caps_get_size(state->caps); ++structure_nr)
 	{
@@ -341,7 +1047,17 @@ static gboolean gst_vmeta_dec_fill_param_set(GstVmetaDec *vmeta_dec, GstVideoCod
 		if (g_strcmp0(name, "video/x-h264") == 0)
 		{
 			vmeta_dec->dec_param_set.strm_fmt = IPP_VIDEO_STRM_FMT_H264;
-			GST_INFO_OBJECT(vmeta_dec, "setting h.264 as stream format");
+
+			/* avc streams have their SPS and PPS in the codec_data (in avcC format) */
+			do_codec_data = (g_strcmp0(gst_structure_get_string(s, "stream-format"), "avc") == 0);
+			vmeta_dec->nal_alignment = (g_strcmp0(gst_structure_get_string(s, "alignment"), "nal") == 0);
+
+			GST_INFO_OBJECT(
+				vmeta_dec,
+				"setting h.264 as stream format (%s, alignment: %s)",
+				do_codec_data ? "avc" : "byte-stream",
+				vmeta_dec->nal_alignment ? "nal" : "au"
+			);
 		}
 		else if (g_strcmp0(name, "video/mpeg") == 0)
 		{
@@ -428,6 +1144,16 @@ static gboolean gst_vmeta_dec_fill_param_set(GstVmetaDec *vmeta_dec, GstVideoCod
 
 		if  (format_set)
 		{
+			gboolean parsed;
+
+			/* Unparsed input is split into access units in the parse function. The sink caps only allow it
+			 * for formats whose sequence headers are sent in-band, so codec_data is not required then. */
+			if (gst_structure_get_boolean(s, "parsed", &parsed) && !parsed)
+			{
+				GST_INFO_OBJECT(vmeta_dec, "input is not parsed; splitting it into access units");
+				vmeta_dec->unparsed_input = TRUE;
+			}
+
 			if (do_codec_data)
 			{
 				GValue const *value = gst_structure_get_value(s, "codec_data");
@@ -436,6 +1162,10 @@ static gboolean gst_vmeta_dec_fill_param_set(GstVmetaDec *vmeta_dec, GstVideoCod
 					GST_INFO_OBJECT(vmeta_dec, "codec data expected and found in caps");
 					*codec_data = gst_value_get_buffer(value);
 				}
+				else if (vmeta_dec->unparsed_input)
+				{
+					GST_INFO_OBJECT(vmeta_dec, "no codec data in caps; expecting in-band sequence headers");
+				}
 				else
 				{
 					GST_WARNING_OBJECT(vmeta_dec, "codec data expected, but not found in caps");
@@ -450,323 +1180,2499 @@ static gboolean gst_vmeta_dec_fill_param_set(GstVmetaDec *vmeta_dec, GstVideoCod
 	if (!format_set)
 		return FALSE;
 
-	vmeta_dec->dec_param_set.opt_fmt = IPP_YCbCr422I;
+	vmeta_dec->output_format = gst_vmeta_dec_choose_output_format(vmeta_dec);
+	switch (vmeta_dec->output_format)
+	{
+		case GST_VIDEO_FORMAT_I420:
+			vmeta_dec->dec_param_set.opt_fmt = IPP_YCbCr420P;
+			break;
+		case GST_VIDEO_FORMAT_NV12:
+			vmeta_dec->dec_param_set.opt_fmt = IPP_YCbCr420SP;
+			break;
+		default:
+			vmeta_dec->dec_param_set.opt_fmt = IPP_YCbCr422I;
+			break;
+	}
 	vmeta_dec->dec_param_set.no_reordering = 0;
-	vmeta_dec->dec_param_set.bMultiIns = 0;
+	/* The engine may be shared with other decoders in this process (see gst_vmeta_dec_decode_loop());
+	 * bFirstUser is set in set_format, once the decoder attaches to the engine */
+	vmeta_dec->dec_param_set.bMultiIns = 1;
 	vmeta_dec->dec_param_set.bFirstUser = 0;
 
 	return TRUE;
 }
 
 
-#ifdef HAVE_VDEC_SUSPEND
-static gboolean gst_vmeta_dec_suspend_and_resume(GstVmetaDec *vmeta_dec)
+static GstVideoFormat gst_vmeta_dec_choose_output_format(GstVmetaDec *vmeta_dec)
 {
-	IppCodecStatus ret;
-
-	/* According to Marvell's GStreamer 0.10 plugins, These steps are necessary
-	 * after a frame was completed when using Dove hardware
-	 * TODO: is this really necessary? */
-	if (!vdec_os_api_suspend_check())
-		return TRUE;
-
-	ret = DecodeSendCmd_Vmeta(IPPVC_PAUSE, NULL, NULL, vmeta_dec->dec_state);
-	if (ret != IPP_STATUS_NOERR)
+	GstCaps *allowed_caps;
+	GstVideoFormat format = GST_VIDEO_FORMAT_UYVY;
+
+	/* The output format has to be chosen before the decoder is initialized, since it is
+	 * part of the parameter set. Pick the first format downstream accepts; the template
+	 * lists UYVY first, so it stays the default if downstream accepts anything. */
+	allowed_caps = gst_pad_get_allowed_caps(GST_VIDEO_DECODER_SRC_PAD(vmeta_dec));
+	if (allowed_caps == NULL)
 	{
-		GST_ERROR_OBJECT(vmeta_dec, "pausing failed : %s", gst_vmeta_dec_strstatus(ret));
-		return FALSE;
+		GST_DEBUG_OBJECT(vmeta_dec, "src pad is not linked; using UYVY as output format");
+		return format;
 	}
 
-	vdec_os_api_suspend_ready();
-
-	ret = DecodeSendCmd_Vmeta(IPPVC_RESUME, NULL, NULL, vmeta_dec->dec_state);
-	if (ret != IPP_STATUS_NOERR)
+	if (!gst_caps_is_empty(allowed_caps))
 	{
-		GST_ERROR_OBJECT(vmeta_dec, "resuming failed : %s", gst_vmeta_dec_strstatus(ret));
-		return FALSE;
+		GstStructure *s;
+		gchar const *format_str;
+
+		allowed_caps = gst_caps_fixate(allowed_caps);
+		s = gst_caps_get_structure(allowed_caps, 0);
+		format_str = gst_structure_get_string(s, "format");
+		if (format_str != NULL)
+			format = gst_video_format_from_string(format_str);
+
+		if ((format != GST_VIDEO_FORMAT_I420) && (format != GST_VIDEO_FORMAT_NV12))
+			format = GST_VIDEO_FORMAT_UYVY;
 	}
 
-	return TRUE;
-}
-#else
-static gboolean gst_vmeta_dec_suspend_and_resume(G_GNUC_UNUSED GstVmetaDec *vmeta_dec)
-{
-	return TRUE;
+	gst_caps_unref(allowed_caps);
+
+	GST_INFO_OBJECT(vmeta_dec, "using %s as output format", gst_video_format_to_string(format));
+
+	return format;
 }
-#endif
 
 
-/* TODO:
- * For hardware other than Marvell's Dove platform, Marvell's GStreamer 0.10 plugins
- * suspend and resume the hardware in the PAUSED<->PLAYING state changes.
- * It is unclear why it isn't used with Dove. Initial tests with Dove didn't show any
- * issues. Still, keeping this code disabled for now until the reason for this
- * exclusion can be found.
- *
- * Not to be confused with the gst_vmeta_dec_suspend_and_resume() function above,
- * which *is* necessary for Dove.
- */
-#if 0
-static gboolean gst_vmeta_dec_suspend(GstVmetaDec *vmeta_dec, gboolean suspend)
+static GstVideoCodecState* gst_vmeta_dec_set_output_state(GstVmetaDec *vmeta_dec, guint width, guint height, GstVideoCodecState *reference)
 {
-	IppCodecStatus ret;
+	GstVideoCodecState *output_state;
 
-	if (vmeta_dec->dec_state == NULL)
-		return TRUE;
+	output_state = gst_video_decoder_set_output_state(GST_VIDEO_DECODER(vmeta_dec), vmeta_dec->output_format, width, height, reference);
 
-	if (vmeta_dec->is_suspended == suspend)
+#ifdef HAVE_VMETA_DMABUF_EXPORT
 	{
-		GST_DEBUG_OBJECT(vmeta_dec, "decoder is already %s - ignoring call", suspend ? "suspended" : "resumed");
-		return TRUE;
-	}
-
-	GST_DEBUG_OBJECT(vmeta_dec, "%s vMeta decoder", suspend ? "suspending" : "resuming");
+		GstCaps *allowed_caps;
+		gboolean export_dmabuf, use_feature = FALSE;
+		guint i;
+
+		GST_OBJECT_LOCK(vmeta_dec);
+		export_dmabuf = vmeta_dec->export_dmabuf;
+		GST_OBJECT_UNLOCK(vmeta_dec);
+
+		/* Exported pictures are announced with the dma-buf caps feature if downstream accepts it;
+		 * otherwise, the regular caps are used, and downstream can still detect the dma-buf
+		 * memory with gst_is_dmabuf_memory() */
+		allowed_caps = export_dmabuf ? gst_pad_get_allowed_caps(GST_VIDEO_DECODER_SRC_PAD(vmeta_dec)) : NULL;
+		if (allowed_caps != NULL)
+		{
+			for (i = 0; !use_feature && (i < gst_caps_get_size(allowed_caps)); ++i)
+				use_feature = gst_caps_features_contains(gst_caps_get_features(allowed_caps, i), GST_CAPS_FEATURE_MEMORY_DMABUF);
+			gst_caps_unref(allowed_caps);
+		}
 
-	ret = DecodeSendCmd_Vmeta(suspend ? IPPVC_PAUSE : IPPVC_RESUME, NULL, NULL, vmeta_dec->dec_state);
-	if (ret != IPP_STATUS_NOERR)
-	{
-		GST_ERROR_OBJECT(vmeta_dec, "could not %s decoder: %s", suspend ? "suspend" : "resume", gst_vmeta_dec_strstatus(ret));
-		return FALSE;
+		if (use_feature)
+		{
+			GST_DEBUG_OBJECT(vmeta_dec, "announcing output pictures with the %s caps feature", GST_CAPS_FEATURE_MEMORY_DMABUF);
+			output_state->caps = gst_video_info_to_caps(&(output_state->info));
+			gst_caps_set_features(output_state->caps, 0, gst_caps_features_new(GST_CAPS_FEATURE_MEMORY_DMABUF, NULL));
+		}
 	}
+#endif
 
-	vmeta_dec->is_suspended = suspend;
-
-	return TRUE;
+	return output_state;
 }
-#else
-static gboolean gst_vmeta_dec_suspend(G_GNUC_UNUSED GstVmetaDec *vmeta_dec, G_GNUC_UNUSED gboolean suspend)
+
+
+static void gst_vmeta_dec_estimate_dpb_size(GstVmetaDec *vmeta_dec, GstVideoCodecState *state)
 {
-	return TRUE;
-}
-#endif
+	/* Maximum DPB size in macroblocks for each h.264 level (table A-1 in the h.264 specification) */
+	static struct { gchar const *level; guint max_dpb_mbs; } const h264_levels[] =
+	{
+		{ "1", 396 }, { "1b", 396 }, { "1.1", 900 }, { "1.2", 2376 }, { "1.3", 2376 },
+		{ "2", 2376 }, { "2.1", 4752 }, { "2.2", 8100 },
+		{ "3", 8100 }, { "3.1", 18000 }, { "3.2", 20480 },
+		{ "4", 32768 }, { "4.1", 32768 }, { "4.2", 34816 },
+		{ "5", 110400 }, { "5.1", 184320 }, { "5.2", 184320 }
+	};
+
+	/* This estimate is only used if the video engine does not report the number
+	 * of required pictures in the sequence info (see gst_vmeta_dec_get_num_required_pictures()) */
+	switch (vmeta_dec->dec_param_set.strm_fmt)
+	{
+		case IPP_VIDEO_STRM_FMT_H264:
+		{
+			gchar const *level = gst_structure_get_string(gst_caps_get_structure(state->caps, 0), "level");
+			guint num_mbs = ((state->info.width + 15) / 16) * ((state->info.height + 15) / 16);
+			guint i;
+
+			/* Without level or frame size, assume the worst case */
+			vmeta_dec->dpb_size = 16;
 
+			if ((level != NULL) && (num_mbs > 0))
+			{
+				for (i = 0; i < G_N_ELEMENTS(h264_levels); ++i)
+				{
+					if (g_strcmp0(level, h264_levels[i].level) == 0)
+					{
+						vmeta_dec->dpb_size = CLAMP(h264_levels[i].max_dpb_mbs / num_mbs, 1, 16);
+						break;
+					}
+				}
+			}
 
+			break;
+		}
+		case IPP_VIDEO_STRM_FMT_MJPG:
+			vmeta_dec->dpb_size = 0;
+			break;
+		default:
+			/* forward and backward reference picture */
+			vmeta_dec->dpb_size = 2;
+			break;
+	}
 
+	GST_DEBUG_OBJECT(vmeta_dec, "estimated DPB size: %u picture(s)", vmeta_dec->dpb_size);
+}
 
-/************************/
-/* list helper function */
 
-static void gst_vmeta_dec_push_to_list(GList **list, gpointer data)
+static guint gst_vmeta_dec_get_num_required_pictures(GstVmetaDec *vmeta_dec)
 {
-	*list = g_list_append(*list, data);
+#ifdef HAVE_VMETA_SEQ_INFO_MAX_NUM_DIS_BUF
+	if (vmeta_dec->dec_info.seq_info.max_num_dis_buf > 0)
+		return vmeta_dec->dec_info.seq_info.max_num_dis_buf;
+#endif
+
+	/* The DPB pictures plus the one currently being decoded */
+	return vmeta_dec->dpb_size + 1;
 }
 
 
-static gpointer gst_vmeta_dec_pop_from_list(GList **list)
+static gboolean gst_vmeta_dec_stream_has_b_frames(GstVmetaDec *vmeta_dec, GstVideoCodecState *state)
 {
-	GList *llink;
-	llink = g_list_first(*list);
-	if (llink == NULL)
+	gchar const *profile = gst_structure_get_string(gst_caps_get_structure(state->caps, 0), "profile");
+
+	/* Only streams whose profile rules out B-frames are considered B-frame free;
+	 * if the profile is unknown, assume the worst case */
+	switch (vmeta_dec->dec_param_set.strm_fmt)
 	{
-		return NULL;
+		case IPP_VIDEO_STRM_FMT_MJPG:
+			return FALSE;
+		case IPP_VIDEO_STRM_FMT_H264:
+			return !((g_strcmp0(profile, "baseline") == 0) || (g_strcmp0(profile, "constrained-baseline") == 0));
+		case IPP_VIDEO_STRM_FMT_MPG4:
+			return g_strcmp0(profile, "simple") != 0;
+		default:
+			return TRUE;
+	}
+}
+
+
+static void gst_vmeta_dec_configure_reordering(GstVmetaDec *vmeta_dec, GstVideoCodecState *state)
+{
+	gboolean low_latency;
+
+	GST_OBJECT_LOCK(vmeta_dec);
+	low_latency = vmeta_dec->low_latency;
+	GST_OBJECT_UNLOCK(vmeta_dec);
+
+	/* Disabling reordering for streams with B-frames would output pictures in the
+	 * wrong order, so low-latency mode is only honored for B-frame free streams */
+	if (low_latency && !gst_vmeta_dec_stream_has_b_frames(vmeta_dec, state))
+	{
+		GST_INFO_OBJECT(vmeta_dec, "low-latency mode: disabling picture reordering");
+		vmeta_dec->dec_param_set.no_reordering = 1;
+	}
+	else
+	{
+		if (low_latency)
+			GST_INFO_OBJECT(vmeta_dec, "low-latency mode requested, but stream may contain B-frames; keeping picture reordering enabled");
+		vmeta_dec->dec_param_set.no_reordering = 0;
+	}
+}
+
+
+static void gst_vmeta_dec_update_latency(GstVmetaDec *vmeta_dec, GstVideoCodecState *state)
+{
+	guint reorder_depth;
+	GstClockTime latency;
+
+	/* Number of pictures the video engine holds back before outputting the
+	 * oldest one; pictures are output as soon as the engine completes them */
+	if (vmeta_dec->dec_param_set.no_reordering)
+		reorder_depth = 0;
+	else if (vmeta_dec->dec_param_set.strm_fmt == IPP_VIDEO_STRM_FMT_H264)
+		reorder_depth = vmeta_dec->dpb_size;
+	else if (vmeta_dec->dec_param_set.strm_fmt == IPP_VIDEO_STRM_FMT_MJPG)
+		reorder_depth = 0;
+	else
+		reorder_depth = 1; /* the backward reference picture of B-frames */
+
+	if ((state->info.fps_n <= 0) || (state->info.fps_d <= 0))
+	{
+		GST_DEBUG_OBJECT(vmeta_dec, "framerate unknown; cannot report latency of %u picture(s)", reorder_depth);
+		return;
+	}
+
+	latency = gst_util_uint64_scale(reorder_depth * GST_SECOND, state->info.fps_d, state->info.fps_n);
+	GST_DEBUG_OBJECT(vmeta_dec, "reorder depth: %u picture(s), latency: %" GST_TIME_FORMAT, reorder_depth, GST_TIME_ARGS(latency));
+
+	gst_video_decoder_set_latency(GST_VIDEO_DECODER(vmeta_dec), latency, latency);
+}
+
+
+static gboolean gst_vmeta_dec_can_reuse_decoder(GstVmetaDec *vmeta_dec, IppVmetaDecParSet const *old_param_set, GstVideoCodecState *state)
+{
+	GstVideoCodecState *output_state;
+	gboolean same_size;
+
+	if (vmeta_dec->dec_param_set.strm_fmt != old_param_set->strm_fmt)
+		return FALSE;
+
+	/* The WMV3 sequence header can only be sent right after initialization */
+	if (vmeta_dec->dec_param_set.strm_fmt == IPP_VIDEO_STRM_FMT_VC1M)
+		return FALSE;
+
+	if (vmeta_dec->dec_param_set.no_reordering != old_param_set->no_reordering)
+		return FALSE;
+
+	if (vmeta_dec->dec_param_set.opt_fmt != old_param_set->opt_fmt)
+		return FALSE;
+
+	output_state = gst_video_decoder_get_output_state(GST_VIDEO_DECODER(vmeta_dec));
+	if (output_state == NULL)
+		return FALSE;
+
+	same_size = (output_state->info.width == state->info.width) && (output_state->info.height == state->info.height);
+	gst_video_codec_state_unref(output_state);
+
+	return same_size;
+}
+
+
+static gboolean gst_vmeta_dec_can_reuse_pool(GstBufferPool *pool, guint size, guint min, guint max, guint *pool_size, guint *pool_min, guint *pool_max)
+{
+	GstStructure *config;
+	gboolean can_reuse;
+
+	if (!gst_buffer_pool_has_option(pool, GST_BUFFER_POOL_OPTION_MVL_VMETA))
+		return FALSE;
+
+	/* The pictures can be kept if their DMA buffers are large enough, and if there are enough
+	 * of them (and the pool may grow enough); the stride and the frame size are updated without
+	 * reallocating anything */
+	config = gst_buffer_pool_get_config(pool);
+	can_reuse = gst_buffer_pool_config_get_params(config, NULL, pool_size, pool_min, pool_max)
+	         && (*pool_size >= size) && (*pool_min >= min) && ((*pool_max == 0) || (*pool_max >= max));
+	gst_structure_free(config);
+
+	return can_reuse;
+}
+
+
+#ifdef HAVE_VDEC_SUSPEND
+static gboolean gst_vmeta_dec_suspend_and_resume(GstVmetaDec *vmeta_dec)
+{
+	IppCodecStatus ret;
+
+	/* According to Marvell's GStreamer 0.10 plugins, These steps are necessary
+	 * after a frame was completed when using Dove hardware
+	 * TODO: is this really necessary? */
+	if (!vdec_os_api_suspend_check())
+		return TRUE;
+
+	ret = DecodeSendCmd_Vmeta(IPPVC_PAUSE, NULL, NULL, vmeta_dec->dec_state);
+	if (ret != IPP_STATUS_NOERR)
+	{
+		GST_ERROR_OBJECT(vmeta_dec, "pausing failed : %s", gst_vmeta_dec_strstatus(ret));
+		return FALSE;
+	}
+
+	vdec_os_api_suspend_ready();
+
+	ret = DecodeSendCmd_Vmeta(IPPVC_RESUME, NULL, NULL, vmeta_dec->dec_state);
+	if (ret != IPP_STATUS_NOERR)
+	{
+		GST_ERROR_OBJECT(vmeta_dec, "resuming failed : %s", gst_vmeta_dec_strstatus(ret));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+#else
+static gboolean gst_vmeta_dec_suspend_and_resume(G_GNUC_UNUSED GstVmetaDec *vmeta_dec)
+{
+	return TRUE;
+}
+#endif
+
+
+/* TODO:
+ * For hardware other than Marvell's Dove platform, Marvell's GStreamer 0.10 plugins
+ * suspend and resume the hardware in the PAUSED<->PLAYING state changes.
+ * It is unclear why it isn't used with Dove. Initial tests with Dove didn't show any
+ * issues. Still, keeping this code disabled for now until the reason for this
+ * exclusion can be found.
+ *
+ * Not to be confused with the gst_vmeta_dec_suspend_and_resume() function above,
+ * which *is* necessary for Dove.
+ */
+#if 0
+static gboolean gst_vmeta_dec_suspend(GstVmetaDec *vmeta_dec, gboolean suspend)
+{
+	IppCodecStatus ret;
+
+	if (vmeta_dec->dec_state == NULL)
+		return TRUE;
+
+	if (vmeta_dec->is_suspended == suspend)
+	{
+		GST_DEBUG_OBJECT(vmeta_dec, "decoder is already %s - ignoring call", suspend ? "suspended" : "resumed");
+		return TRUE;
+	}
+
+	GST_DEBUG_OBJECT(vmeta_dec, "%s vMeta decoder", suspend ? "suspending" : "resuming");
+
+	ret = DecodeSendCmd_Vmeta(suspend ? IPPVC_PAUSE : IPPVC_RESUME, NULL, NULL, vmeta_dec->dec_state);
+	if (ret != IPP_STATUS_NOERR)
+	{
+		GST_ERROR_OBJECT(vmeta_dec, "could not %s decoder: %s", suspend ? "suspend" : "resume", gst_vmeta_dec_strstatus(ret));
+		return FALSE;
+	}
+
+	vmeta_dec->is_suspended = suspend;
+
+	return TRUE;
+}
+#else
+static gboolean gst_vmeta_dec_suspend(G_GNUC_UNUSED GstVmetaDec *vmeta_dec, G_GNUC_UNUSED gboolean suspend)
+{
+	return TRUE;
+}
+#endif
+
+
+
+
+/***************************/
+/* stream buffer functions */
+
+static guint gst_vmeta_dec_get_stream_prefix_size(GstVmetaDec *vmeta_dec, guint8 const *in_data, gsize in_size, gboolean *add_vc1_code)
+{
+	guint prefix_size = 0;
+
+	/* the VC1 frame start code is optional, but vMeta requires it.
+	 * In case the input data is a VC1 stream, and there is no frame start code present,
+	 * make room for one.
+	 */
+
+	*add_vc1_code = (vmeta_dec->dec_param_set.strm_fmt == IPP_VIDEO_STRM_FMT_VC1) && ((in_size < 3) || (gst_vmeta_bitstream_find_start_code(in_data, 3, 0) != 0));
+	if (*add_vc1_code)
+		prefix_size += 4;
+
+	/* In case there is codec_data, make room for it.
+	 * This is done only for the first frame; afterwards, codec_data is NULL. */
+	if (vmeta_dec->codec_data != NULL)
+		prefix_size += gst_buffer_get_size(vmeta_dec->codec_data);
+
+	return prefix_size;
+}
+
+
+static void gst_vmeta_dec_write_stream_prefix(GstVmetaDec *vmeta_dec, guint8 *dest, gboolean add_vc1_code)
+{
+	guint offset = 0;
+
+	/* In case there is codec data, copy it over to the stream.
+	 * This is done only for the first frame; after copying, the codec_data
+	 * buffer is unref'd, and codec_data is set to NULL. */
+	if (vmeta_dec->codec_data != NULL)
+	{
+		GstMapInfo in_map_info;
+
+		gst_buffer_map(vmeta_dec->codec_data, &in_map_info, GST_MAP_READ);
+		memcpy(dest + offset, in_map_info.data, in_map_info.size);
+		offset += in_map_info.size;
+		gst_buffer_unmap(vmeta_dec->codec_data, &in_map_info);
+
+		gst_buffer_unref(vmeta_dec->codec_data);
+		vmeta_dec->codec_data = NULL;
+	}
+
+	/* For VC1 streams, copy over the start frame code */
+	if (add_vc1_code)
+	{
+		static guint8 const VC1FrameStartCode[4] = {0, 0, 1, 0xd};
+		dest[offset + 0] = VC1FrameStartCode[0];
+		dest[offset + 1] = VC1FrameStartCode[1];
+		dest[offset + 2] = VC1FrameStartCode[2];
+		dest[offset + 3] = VC1FrameStartCode[3];
+	}
+}
+
+
+static int gst_vmeta_dec_compare_sizes(void const *first, void const *second)
+{
+	guint a = *((guint const *)first);
+	guint b = *((guint const *)second);
+	return (a > b) - (a < b);
+}
+
+
+static void gst_vmeta_dec_set_stream_size(GstVmetaDec *vmeta_dec, guint size)
+{
+	guint min_size, max_size;
+
+	GST_OBJECT_LOCK(vmeta_dec);
+	min_size = vmeta_dec->min_stream_size;
+	max_size = vmeta_dec->max_stream_size;
+	GST_OBJECT_UNLOCK(vmeta_dec);
+
+	/* The maximum takes precedence if the bounds contradict each other */
+	size = MAX(size, min_size);
+	size = MIN(size, max_size);
+	size = ALIGN_VAL_TO(size, STREAM_VDECBUF_ALIGN);
+
+	if (size != vmeta_dec->stream_size)
+	{
+		GST_DEBUG_OBJECT(vmeta_dec, "stream size changed from %u to %u byte", vmeta_dec->stream_size, size);
+		vmeta_dec->stream_size = size;
+	}
+}
+
+
+static void gst_vmeta_dec_init_stream_size(GstVmetaDec *vmeta_dec, GstVideoCodecState *state)
+{
+	guint size;
+
+	/* Until access unit sizes have been observed, estimate the stream size from the
+	 * frame size and the codec. Motion JPEG frames are all intra-coded, and therefore
+	 * considerably larger than the average frame of the other codecs. */
+	if ((state->info.width > 0) && (state->info.height > 0))
+	{
+		guint raw_size = state->info.width * state->info.height * 3 / 2;
+		size = (vmeta_dec->dec_param_set.strm_fmt == IPP_VIDEO_STRM_FMT_MJPG) ? (raw_size / 4) : (raw_size / 8);
+	}
+	else
+		size = STREAM_VDECBUF_SIZE;
+
+	vmeta_dec->au_size_history_pos = 0;
+	vmeta_dec->au_size_history_length = 0;
+	vmeta_dec->num_au_sizes_since_update = 0;
+
+	gst_vmeta_dec_set_stream_size(vmeta_dec, size);
+}
+
+
+static void gst_vmeta_dec_record_au_size(GstVmetaDec *vmeta_dec, guint au_size)
+{
+	guint sorted_sizes[GST_VMETA_DEC_AU_SIZE_HISTORY_LENGTH];
+	guint percentile_size;
+
+	vmeta_dec->au_size_history[vmeta_dec->au_size_history_pos] = au_size;
+	vmeta_dec->au_size_history_pos = (vmeta_dec->au_size_history_pos + 1) % GST_VMETA_DEC_AU_SIZE_HISTORY_LENGTH;
+	if (vmeta_dec->au_size_history_length < GST_VMETA_DEC_AU_SIZE_HISTORY_LENGTH)
+		++vmeta_dec->au_size_history_length;
+
+	/* Only update the stream size every few access units; since the percentile is taken
+	 * over a longer history, short bitrate peaks or drops do not affect the stream size */
+	if (++vmeta_dec->num_au_sizes_since_update < STREAM_SIZE_UPDATE_INTERVAL)
+		return;
+	vmeta_dec->num_au_sizes_since_update = 0;
+
+	memcpy(sorted_sizes, vmeta_dec->au_size_history, vmeta_dec->au_size_history_length * sizeof(guint));
+	qsort(sorted_sizes, vmeta_dec->au_size_history_length, sizeof(guint), gst_vmeta_dec_compare_sizes);
+	percentile_size = sorted_sizes[(vmeta_dec->au_size_history_length - 1) * STREAM_SIZE_PERCENTILE / 100];
+
+	/* Add 25% headroom on top of the percentile */
+	gst_vmeta_dec_set_stream_size(vmeta_dec, percentile_size + percentile_size / 4);
+}
+
+
+static IppVmetaBitstream* gst_vmeta_dec_create_stream(GstVmetaDec *vmeta_dec)
+{
+	IppVmetaBitstream *stream;
+
+	/* Must be called with the streams mutex held */
+
+	if (vmeta_dec->num_streams >= vmeta_dec->streams_available.capacity)
+		return NULL;
+
+	stream = (IppVmetaBitstream *)g_try_malloc0(sizeof(IppVmetaBitstream));
+	if (stream == NULL)
+	{
+		GST_ERROR_OBJECT(vmeta_dec, "failed to allocate stream");
+		return NULL;
+	}
+
+	/* The DMA buffer is allocated when the stream is filled for the first time,
+	 * since only then the necessary size is known */
+	vmeta_dec->streams[vmeta_dec->num_streams++] = stream;
+
+	GST_DEBUG_OBJECT(vmeta_dec, "created stream #%u", vmeta_dec->num_streams);
+
+	return stream;
+}
+
+
+static gsize gst_vmeta_dec_get_avc_stream_size(GstVmetaDec *vmeta_dec, GstBuffer *input_buffer)
+{
+	guint8 prefix[4];
+	guint i, nal_length_size = vmeta_dec->bitstream_parser.h264_nal_length_size;
+	gsize offset = 0, nal_size, in_size, stream_size = 0;
+
+	in_size = gst_buffer_get_size(input_buffer);
+
+	/* Length prefixes of 3 and 4 bytes are replaced with start codes of the same size;
+	 * shorter ones are replaced with 3-byte start codes, which makes the data larger */
+	if (nal_length_size >= 3)
+		return in_size;
+
+	while ((offset + nal_length_size) <= in_size)
+	{
+		gst_buffer_extract(input_buffer, offset, prefix, nal_length_size);
+		offset += nal_length_size;
+
+		nal_size = 0;
+		for (i = 0; i < nal_length_size; ++i)
+			nal_size = (nal_size << 8) | prefix[i];
+		nal_size = MIN(nal_size, in_size - offset);
+
+		stream_size += 3 + nal_size;
+		offset += nal_size;
+	}
+
+	return stream_size;
+}
+
+
+static gsize gst_vmeta_dec_convert_input_data(GstVmetaDecAvcConversion *conversion, guint8 const *src, gsize size, guint8 *dest)
+{
+	gsize in_pos = 0, out_pos = 0, num_bytes;
+
+	/* Copies the data, and replaces the NAL unit length prefixes of avc data with start codes
+	 * on the way; returns the number of bytes written. Called once per memory block, so a
+	 * prefix or a NAL unit may continue in the next block. */
+
+	if (conversion->nal_length_size == 0)
+	{
+		memcpy(dest, src, size);
+		return size;
+	}
+
+	while (in_pos < size)
+	{
+		if (conversion->prefix_pos < conversion->nal_length_size)
+		{
+			conversion->nal_remaining = (conversion->nal_remaining << 8) | src[in_pos++];
+			if (++conversion->prefix_pos < conversion->nal_length_size)
+				continue;
+
+			if (conversion->nal_length_size == 4)
+				dest[out_pos++] = 0;
+			dest[out_pos++] = 0;
+			dest[out_pos++] = 0;
+			dest[out_pos++] = 1;
+		}
+		else
+		{
+			num_bytes = MIN(conversion->nal_remaining, size - in_pos);
+			memcpy(dest + out_pos, src + in_pos, num_bytes);
+			in_pos += num_bytes;
+			out_pos += num_bytes;
+			conversion->nal_remaining -= num_bytes;
+		}
+
+		/* NAL unit finished; the next length prefix follows */
+		if ((conversion->prefix_pos == conversion->nal_length_size) && (conversion->nal_remaining == 0))
+			conversion->prefix_pos = 0;
+	}
+
+	return out_pos;
+}
+
+
+static gboolean gst_vmeta_dec_copy_memories(GstVmetaDec *vmeta_dec, GstBuffer *input_buffer, guint8 *dest, gsize *copied_size)
+{
+	guint i, num_memories;
+	gsize offset = 0;
+	GstMapInfo map_info;
+	GstVmetaDecAvcConversion conversion = { vmeta_dec->bitstream_parser.h264_nal_length_size, 0, 0 };
+
+	/* Copies the input buffer's memory blocks one after the other, so each byte is copied exactly once.
+	 * Returns FALSE if one of the blocks cannot be mapped on its own. */
+
+	num_memories = gst_buffer_n_memory(input_buffer);
+
+	if (num_memories > 1)
+		GST_CAT_LOG_OBJECT(GST_CAT_PERFORMANCE, vmeta_dec, "copying %u memory blocks of input buffer %p separately", num_memories, (gpointer)input_buffer);
+
+	for (i = 0; i < num_memories; ++i)
+	{
+		GstMemory *mem = gst_buffer_peek_memory(input_buffer, i);
+
+		if (!gst_memory_map(mem, &map_info, GST_MAP_READ))
+		{
+			GST_DEBUG_OBJECT(vmeta_dec, "could not map memory block %u of input buffer %p", i, (gpointer)input_buffer);
+			return FALSE;
+		}
+
+		offset += gst_vmeta_dec_convert_input_data(&conversion, map_info.data, map_info.size, dest + offset);
+
+		gst_memory_unmap(mem, &map_info);
+	}
+
+	*copied_size = offset;
+
+	return TRUE;
+}
+
+
+static gboolean gst_vmeta_dec_copy_to_stream(GstVmetaDec *vmeta_dec, IppVmetaBitstream *stream, GstBuffer *input_buffer)
+{
+	unsigned int num_padding, extra_bytes, in_size_total, new_buf_size;
+	guint8 in_start[3];
+	gsize in_size, in_start_size, copied_size;
+	gboolean add_vc1_code;
+
+	/* avc data gets start codes instead of length prefixes, which may change its size */
+	if (vmeta_dec->bitstream_parser.h264_nal_length_size > 0)
+		in_size = gst_vmeta_dec_get_avc_stream_size(vmeta_dec, input_buffer);
+	else
+		in_size = gst_buffer_get_size(input_buffer);
+
+	/* Only the first bytes are needed for determining the prefix; extracting them
+	 * does not merge the memory blocks */
+	in_start_size = gst_buffer_extract(input_buffer, 0, in_start, sizeof(in_start));
+
+	extra_bytes = gst_vmeta_dec_get_stream_prefix_size(vmeta_dec, in_start, in_start_size, &add_vc1_code);
+
+	/* Total size for the stream, including extra bytes added above */
+	in_size_total = in_size + extra_bytes;
+
+	GST_DEBUG_OBJECT(vmeta_dec, "VC1 start code: %s", add_vc1_code ? "yes" : "no");
+
+	/* If the stream is not big enough (including padding), enlarge it. Add some extra
+	 * space, so that slightly larger access units do not cause another reallocation.
+	 * Conversely, if the stream is much larger than the current stream size, and the
+	 * data fits in a stream of that size, shrink it. Since the stream size follows
+	 * the access unit sizes only slowly, this happens after a sustained bitrate drop.
+	 * The stream's DMA buffer size must always be aligned to 64kB boundaries. */
+	if (PADDED_SIZE(in_size_total) > stream->nBufSize)
+		new_buf_size = MAX(ALIGN_VAL_TO(in_size_total, STREAM_VDECBUF_ALIGN) + STREAM_VDECBUF_ALIGN, vmeta_dec->stream_size);
+	else if ((stream->nBufSize >= (vmeta_dec->stream_size * STREAM_SHRINK_FACTOR)) && (PADDED_SIZE(in_size_total) <= vmeta_dec->stream_size))
+		new_buf_size = vmeta_dec->stream_size;
+	else
+		new_buf_size = 0;
+
+	if (new_buf_size != 0)
+	{
+		GST_DEBUG_OBJECT(
+			vmeta_dec,
+			"need to reallocate stream buffer: necessary stream buffer size: %u  current size: %u  new size: %u",
+			PADDED_SIZE(in_size_total),
+			stream->nBufSize,
+			new_buf_size
+		);
+
+		if (stream->pBuf != NULL)
+			vdec_os_api_dma_free(stream->pBuf);
+		stream->pBuf = vdec_os_api_dma_alloc_writecombine(new_buf_size, VMETA_STRM_BUF_ALIGN, &(stream->nPhyAddr));
+		stream->nBufSize = new_buf_size;
+		stream->nDataLen = 0;
+
+		if (stream->pBuf == NULL)
+		{
+			GST_ERROR_OBJECT(vmeta_dec, "reallocating stream buffer failed");
+			stream->nBufSize = 0;
+			return FALSE;
+		}
+	}
+
+	/* Copy over the codec data and/or the VC1 start code, followed by the input frame data
+	 * (converted to byte-stream format if it is avc data) */
+	gst_vmeta_dec_write_stream_prefix(vmeta_dec, stream->pBuf, add_vc1_code);
+	if (!gst_vmeta_dec_copy_memories(vmeta_dec, input_buffer, stream->pBuf + extra_bytes, &copied_size))
+	{
+		GstMapInfo in_map_info;
+		GstVmetaDecAvcConversion conversion = { vmeta_dec->bitstream_parser.h264_nal_length_size, 0, 0 };
+
+		/* Fall back to mapping the buffer as a whole; with several memory
+		 * blocks, this merges them into a temporary buffer first */
+		if (!gst_buffer_map(input_buffer, &in_map_info, GST_MAP_READ))
+		{
+			GST_ERROR_OBJECT(vmeta_dec, "could not map input buffer");
+			return FALSE;
+		}
+
+		copied_size = gst_vmeta_dec_convert_input_data(&conversion, in_map_info.data, in_map_info.size, stream->pBuf + extra_bytes);
+		gst_buffer_unmap(input_buffer, &in_map_info);
+
+		if (gst_buffer_n_memory(input_buffer) > 1)
+		{
+			GST_CAT_INFO_OBJECT(GST_CAT_PERFORMANCE, vmeta_dec, "input buffer %p with %u memory blocks had to be merged before copying", (gpointer)input_buffer, gst_buffer_n_memory(input_buffer));
+			GST_OBJECT_LOCK(vmeta_dec);
+			++vmeta_dec->num_merged_uploads;
+			GST_OBJECT_UNLOCK(vmeta_dec);
+		}
+	}
+
+	/* Truncated avc data can produce less than announced */
+	in_size_total = extra_bytes + copied_size;
+
+	stream->nDataLen = in_size_total;
+	stream->nFlag = IPP_VMETA_STRM_BUF_END_OF_UNIT; /* Necessary flag for vMeta input */
+
+	/* vMeta requires padded bytes to be of value 0x88
+	 * (which is the value of PADDING_BYTE) */
+	num_padding = PADDING_LEN(in_size_total);
+	if (num_padding > 0)
+		memset(stream->pBuf + in_size_total, PADDING_BYTE, num_padding);
+
+	return TRUE;
+}
+
+
+static gboolean gst_vmeta_dec_wrap_input_buffer(GstVmetaDec *vmeta_dec, IppVmetaBitstream *stream, GstBuffer *input_buffer)
+{
+	GstMemory *mem;
+	GstVmetaMemory *vmeta_mem;
+	guint8 *in_data;
+	gsize in_size, available_size;
+	unsigned int num_padding, extra_bytes, in_size_total, buf_size;
+	gboolean add_vc1_code;
+
+	/* Only buffers with exactly one vMeta DMA memory block can be passed to
+	 * the video engine directly. The prefix and the padding are written into
+	 * the headroom and the tail of the memory block, so both the buffer and
+	 * the memory must be writable; shared and sub-memory blocks are excluded,
+	 * since their headroom and tail may contain another buffer's visible data.
+	 * avc data has to be converted, which requires a copy. */
+	if ((gst_buffer_n_memory(input_buffer) != 1) || (vmeta_dec->bitstream_parser.h264_nal_length_size > 0))
+		return FALSE;
+
+	mem = gst_buffer_peek_memory(input_buffer, 0);
+	if (!GST_IS_VMETA_ALLOCATOR(mem->allocator) || (mem->parent != NULL))
+		return FALSE;
+
+	if (!gst_buffer_is_writable(input_buffer) || !gst_memory_is_writable(mem))
+	{
+		GST_LOG_OBJECT(vmeta_dec, "DMA input buffer is not writable - copying");
+		return FALSE;
+	}
+
+	vmeta_mem = (GstVmetaMemory *)mem;
+	in_data = (guint8 *)(vmeta_mem->virt_addr) + mem->offset;
+	in_size = mem->size;
+
+	extra_bytes = gst_vmeta_dec_get_stream_prefix_size(vmeta_dec, in_data, in_size, &add_vc1_code);
+	in_size_total = in_size + extra_bytes;
+	num_padding = PADDING_LEN(in_size_total);
+
+	/* The codec data and the VC1 start code must fit in the headroom,
+	 * the padding in the area after the data */
+	if ((mem->offset < extra_bytes) || ((mem->maxsize - mem->offset - mem->size) < num_padding))
+	{
+		GST_LOG_OBJECT(vmeta_dec, "not enough headroom or tail room in DMA input buffer - copying");
+		return FALSE;
+	}
+
+	/* The stream start must satisfy the alignment requirements, and the
+	 * stream's DMA buffer size must be aligned to 64kB boundaries */
+	if (((((guintptr)in_data) - extra_bytes) % VMETA_STRM_BUF_ALIGN) != 0)
+	{
+		GST_LOG_OBJECT(vmeta_dec, "DMA input buffer data is not aligned - copying");
+		return FALSE;
+	}
+
+	available_size = mem->maxsize - (mem->offset - extra_bytes);
+	buf_size = (available_size / STREAM_VDECBUF_ALIGN) * STREAM_VDECBUF_ALIGN;
+	if (buf_size < PADDED_SIZE(in_size_total))
+	{
+		GST_LOG_OBJECT(vmeta_dec, "DMA input buffer is too small to be used as stream - copying");
+		return FALSE;
+	}
+
+	GST_LOG_OBJECT(vmeta_dec, "input buffer %p is in vMeta DMA memory - passing it directly to the video engine", (gpointer)input_buffer);
+
+	/* Write the prefix and the padding outside of the memory's visible region;
+	 * the upstream data itself is not modified */
+	gst_vmeta_dec_write_stream_prefix(vmeta_dec, in_data - extra_bytes, add_vc1_code);
+	if (num_padding > 0)
+		memset(in_data + in_size, PADDING_BYTE, num_padding);
+
+	/* The vMeta API only takes 32-bit addresses; cast through guintptr to make this explicit */
+	if (GST_VMETA_ALLOCATOR(mem->allocator)->type == GST_VMETA_ALLOCATOR_TYPE_CACHEABLE)
+		vdec_os_api_flush_cache((UNSG32)(guintptr)(in_data - extra_bytes), PADDED_SIZE(in_size_total), DMA_TO_DEVICE);
+
+	/* Keep the stream's own DMA buffer in the spare user data pointers,
+	 * so it can be restored once the video engine returns the stream */
+	stream->pUsrData0 = gst_buffer_ref(input_buffer);
+	stream->pUsrData1 = stream->pBuf;
+	stream->pUsrData2 = GUINT_TO_POINTER(stream->nPhyAddr);
+	stream->pUsrData3 = GUINT_TO_POINTER(stream->nBufSize);
+
+	stream->pBuf = in_data - extra_bytes;
+	stream->nPhyAddr = vmeta_mem->phys_addr + mem->offset - extra_bytes;
+	stream->nBufSize = buf_size;
+	stream->nDataLen = in_size_total;
+	stream->nFlag = IPP_VMETA_STRM_BUF_END_OF_UNIT; /* Necessary flag for vMeta input */
+
+	return TRUE;
+}
+
+
+static void gst_vmeta_dec_clear_stream(IppVmetaBitstream *stream)
+{
+	stream->nDataLen = 0;
+
+	/* If the stream wraps an input buffer, release it,
+	 * and restore the stream's own DMA buffer */
+	if (stream->pUsrData0 != NULL)
+	{
+		gst_buffer_unref((GstBuffer *)(stream->pUsrData0));
+
+		stream->pBuf = stream->pUsrData1;
+		stream->nPhyAddr = GPOINTER_TO_UINT(stream->pUsrData2);
+		stream->nBufSize = GPOINTER_TO_UINT(stream->pUsrData3);
+
+		stream->pUsrData0 = NULL;
+		stream->pUsrData1 = NULL;
+		stream->pUsrData2 = NULL;
+		stream->pUsrData3 = NULL;
+	}
+}
+
+
+static GstFlowReturn gst_vmeta_dec_acquire_stream(GstVmetaDec *vmeta_dec, IppVmetaBitstream **stream)
+{
+	GstFlowReturn flow_ret = GST_FLOW_OK;
+
+	g_mutex_lock(&(vmeta_dec->streams_mutex));
+
+	*stream = gst_vmeta_dec_stream_queue_pop(&(vmeta_dec->streams_available));
+
+	/* Streams are created on demand, up to the maximum number of streams */
+	if (*stream == NULL)
+		*stream = gst_vmeta_dec_create_stream(vmeta_dec);
+
+	/* In decode thread mode, all streams may currently be queued or inside the
+	 * video engine; wait until the decode thread returns one. The thread is not
+	 * running in key unit trick modes (see gst_vmeta_dec_handle_frame()). */
+	if (vmeta_dec->decode_thread != NULL)
+	{
+		while ((*stream == NULL) && (vmeta_dec->decode_thread_flow_ret == GST_FLOW_OK))
+		{
+			GST_LOG_OBJECT(vmeta_dec, "no streams available - waiting for decode thread");
+			gst_vmeta_dec_wait_for_decode_thread(vmeta_dec);
+			*stream = gst_vmeta_dec_stream_queue_pop(&(vmeta_dec->streams_available));
+		}
+
+		if (*stream == NULL)
+			flow_ret = vmeta_dec->decode_thread_flow_ret;
+	}
+	else if (*stream == NULL)
+	{
+		GST_ERROR_OBJECT(vmeta_dec, "no streams available");
+		flow_ret = GST_FLOW_ERROR;
+	}
+
+	g_mutex_unlock(&(vmeta_dec->streams_mutex));
+
+	return flow_ret;
+}
+
+
+static void gst_vmeta_dec_release_stream(GstVmetaDec *vmeta_dec, IppVmetaBitstream *stream, gboolean ready)
+{
+	g_mutex_lock(&(vmeta_dec->streams_mutex));
+
+	if (ready)
+		gst_vmeta_dec_stream_queue_push(&(vmeta_dec->streams_ready), stream);
+	else
+	{
+		gst_vmeta_dec_clear_stream(stream);
+		gst_vmeta_dec_stream_queue_push(&(vmeta_dec->streams_available), stream);
+	}
+
+	g_cond_broadcast(&(vmeta_dec->streams_cond));
+	g_mutex_unlock(&(vmeta_dec->streams_mutex));
+}
+
+
+static IppVmetaBitstream* gst_vmeta_dec_pop_ready_stream(GstVmetaDec *vmeta_dec)
+{
+	IppVmetaBitstream *stream;
+
+	g_mutex_lock(&(vmeta_dec->streams_mutex));
+
+	/* If no stream is ready, the video engine has to wait for new input;
+	 * the next ready stream is then pushed before DecodeFrame_Vmeta() is called again */
+	stream = gst_vmeta_dec_stream_queue_pop(&(vmeta_dec->streams_ready));
+	vmeta_dec->upload_before_loop = (stream == NULL);
+
+	g_mutex_unlock(&(vmeta_dec->streams_mutex));
+
+	return stream;
+}
+
+
+static gboolean gst_vmeta_dec_push_stream(GstVmetaDec *vmeta_dec, IppVmetaBitstream *stream)
+{
+	IppCodecStatus ret;
+
+	ret = DecoderPushBuffer_Vmeta(IPP_VMETA_BUF_TYPE_STRM, stream, vmeta_dec->dec_state);
+	if (ret != IPP_STATUS_NOERR)
+	{
+		gst_vmeta_dec_release_stream(vmeta_dec, stream, FALSE);
+		GST_ERROR_OBJECT(vmeta_dec, "failed to push stream buffer : %s", gst_vmeta_dec_strstatus(ret));
+		return FALSE;
+	}
+
+	/* Each input stream is expected to produce one picture */
+	++vmeta_dec->num_expected_pictures;
+	++vmeta_dec->num_engine_streams;
+
+	return TRUE;
+}
+
+
+static GstFlowReturn gst_vmeta_dec_push_queued_streams(GstVmetaDec *vmeta_dec, guint input_queue_depth)
+{
+	IppVmetaBitstream *stream;
+	GstFlowReturn flow_ret;
+
+	/* Called by the decode loop, with the engine acquired. Hands further ready streams to the engine
+	 * until it holds input_queue_depth streams, without waiting for IPP_STATUS_NEED_INPUT.
+	 * Unlike gst_vmeta_dec_pop_ready_stream(), this does not touch upload_before_loop, since the
+	 * engine is not waiting for input here. */
+	while (vmeta_dec->num_engine_streams < input_queue_depth)
+	{
+		g_mutex_lock(&(vmeta_dec->streams_mutex));
+		stream = gst_vmeta_dec_stream_queue_pop(&(vmeta_dec->streams_ready));
+		g_mutex_unlock(&(vmeta_dec->streams_mutex));
+
+		if (stream == NULL)
+			break;
+
+		GST_LOG_OBJECT(vmeta_dec, "pushing stream %p ahead of time (%u stream(s) in engine)", (gpointer)stream, vmeta_dec->num_engine_streams);
+
+		if (!gst_vmeta_dec_push_stream(vmeta_dec, stream))
+			return GST_FLOW_ERROR;
+
+		flow_ret = gst_vmeta_dec_output_held_picture(vmeta_dec);
+		if (flow_ret != GST_FLOW_OK)
+			return flow_ret;
+	}
+
+	return GST_FLOW_OK;
+}
+
+
+static gboolean gst_vmeta_dec_return_stream_buffers(GstVmetaDec *vmeta_dec)
+{
+	IppCodecStatus ret;
+	IppVmetaBitstream *stream;
+	gboolean retval = TRUE;
+
+	g_mutex_lock(&(vmeta_dec->streams_mutex));
+
+	while (TRUE)
+	{
+		ret = DecoderPopBuffer_Vmeta(IPP_VMETA_BUF_TYPE_STRM, (void **)(&stream), vmeta_dec->dec_state);
+		if (ret != IPP_STATUS_NOERR)
+		{
+			GST_ERROR_OBJECT(vmeta_dec, "failed to pop stream : %s", gst_vmeta_dec_strstatus(ret));
+			retval = FALSE;
+			break;
+		}
+
+		if (stream == NULL)
+		{
+			GST_LOG_OBJECT(vmeta_dec, "popped NULL stream");
+			break;
+		}
+
+		GST_LOG_OBJECT(vmeta_dec, "popped stream %p", stream);
+
+		if (vmeta_dec->num_engine_streams > 0)
+			--vmeta_dec->num_engine_streams;
+
+		gst_vmeta_dec_clear_stream(stream);
+		gst_vmeta_dec_stream_queue_push(&(vmeta_dec->streams_available), stream);
+	}
+
+	g_cond_broadcast(&(vmeta_dec->streams_cond));
+	g_mutex_unlock(&(vmeta_dec->streams_mutex));
+
+	return retval;
+}
+
+
+
+
+/****************************/
+/* picture buffer functions */
+
+static gboolean gst_vmeta_dec_return_picture_buffers(GstVmetaDec *vmeta_dec)
+{
+	IppCodecStatus ret;
+	IppVmetaPicture *picture;
+	GstBuffer *picture_buffer;
+
+	while (TRUE)
+	{
+		ret = DecoderPopBuffer_Vmeta(IPP_VMETA_BUF_TYPE_PIC, (void **)(&picture), vmeta_dec->dec_state);
+		if (ret != IPP_STATUS_NOERR)
+		{
+			GST_ERROR_OBJECT(vmeta_dec, "popping picture failed : %s", gst_vmeta_dec_strstatus(ret));
+			return FALSE;
+		}
+
+		if (picture == NULL)
+		{
+			GST_LOG_OBJECT(vmeta_dec, "popped NULL picture");
+			break;
+		}
+
+		if (vmeta_dec->num_engine_pictures > 0)
+			--vmeta_dec->num_engine_pictures;
+
+		picture_buffer = gst_vmeta_dec_get_buffer_from_ipp_picture(vmeta_dec, picture);
+		if (picture_buffer != NULL)
+		{
+			GST_LOG_OBJECT(vmeta_dec, "popped picture %p (gstreamer buffer %p)", picture, picture_buffer);
+			gst_buffer_unref(picture_buffer);
+		}
+		else
+			GST_LOG_OBJECT(vmeta_dec, "popped picture %p (no gstreamer buffer)", picture);
+	}
+
+	/* All pictures are out of the engine now */
+	vmeta_dec->num_engine_pictures = 0;
+
+	return TRUE;
+}
+
+
+static IppVmetaPicture* gst_vmeta_dec_get_ipp_picture_from_buffer(GstVmetaDec *vmeta_decoder, GstBuffer *buffer)
+{
+	GstVmetaBufferMeta *meta = GST_VMETA_BUFFER_META_GET(buffer);
+	if (meta == NULL)
+	{
+		GST_ERROR_OBJECT(vmeta_decoder, "picture buffer has no vMeta metadata");
+		return NULL;
+	}
+
+	return (IppVmetaPicture *)(meta->mvl_ipp_data);
+}
+
+
+static GstBuffer* gst_vmeta_dec_get_buffer_from_ipp_picture(GstVmetaDec *vmeta_decoder, IppVmetaPicture *picture)
+{
+	if (picture->pUsrData0 == NULL)
+	{
+		GST_ERROR_OBJECT(vmeta_decoder, "IPP picture %p is not associated with a gst buffer", picture);
+		return NULL;
+	}
+
+	return (GstBuffer *)(picture->pUsrData0);
+}
+
+
+static gboolean gst_vmeta_dec_crop_picture(GstVmetaDec *vmeta_dec, GstBuffer **picture_buffer)
+{
+	IppVmetaPicture *picture;
+	IppiRect const *roi;
+	GstVideoCodecState *output_state;
+	GstVideoMeta *video_meta;
+	GstVideoFrame src_frame, dest_frame;
+	GstBuffer *cropped_buffer;
+	guint i;
+	gboolean same_size, copy_needed, copied;
+
+	/* Must be called with the stream lock held. The engine writes into buffers padded to
+	 * whole macroblocks; the picture's ROI is the part which is actually displayed. */
+
+	picture = gst_vmeta_dec_get_ipp_picture_from_buffer(vmeta_dec, *picture_buffer);
+	if (picture == NULL)
+		return FALSE;
+
+	roi = &(picture->pic.picROI);
+
+	/* Downstream can crop by itself; the video meta describes the whole padded picture */
+	if (vmeta_dec->downstream_crop_meta)
+	{
+		GstVideoCropMeta *crop_meta;
+		guint width = MAX(vmeta_dec->dec_info.seq_info.max_width, (guint)(roi->x + roi->width));
+		guint height = MAX(vmeta_dec->dec_info.seq_info.max_height, (guint)(roi->y + roi->height));
+
+		gst_vmeta_buffer_pool_set_video_meta_window(*picture_buffer, 0, 0, width, height);
+
+		crop_meta = gst_buffer_get_video_crop_meta(*picture_buffer);
+		if (crop_meta == NULL)
+			crop_meta = gst_buffer_add_video_crop_meta(*picture_buffer);
+		crop_meta->x = roi->x;
+		crop_meta->y = roi->y;
+		crop_meta->width = roi->width;
+		crop_meta->height = roi->height;
+
+		return TRUE;
+	}
+
+	/* Otherwise, the video meta describes only the displayed part; this is enough
+	 * if downstream supports video metas */
+	gst_vmeta_buffer_pool_set_video_meta_window(*picture_buffer, roi->x, roi->y, roi->width, roi->height);
+	if (vmeta_dec->downstream_video_meta)
+		return TRUE;
+
+	/* Downstream expects the default layout for the output caps. Only if the
+	 * picture's layout differs from it does it have to be copied. */
+	output_state = gst_video_decoder_get_output_state(GST_VIDEO_DECODER(vmeta_dec));
+	if (output_state == NULL)
+		return TRUE;
+
+	video_meta = gst_buffer_get_video_meta(*picture_buffer);
+	same_size = (video_meta != NULL) && ((gint)(video_meta->width) == GST_VIDEO_INFO_WIDTH(&(output_state->info))) && ((gint)(video_meta->height) == GST_VIDEO_INFO_HEIGHT(&(output_state->info)));
+	if (!same_size)
+	{
+		/* A picture from before a resolution change; it cannot be adapted to the new caps */
+		if (video_meta != NULL)
+			GST_DEBUG_OBJECT(vmeta_dec, "picture size %ux%u does not match the output caps; pushing it as-is", video_meta->width, video_meta->height);
+		gst_video_codec_state_unref(output_state);
+		return TRUE;
+	}
+
+	copy_needed = FALSE;
+	for (i = 0; i < video_meta->n_planes; ++i)
+	{
+		if ((video_meta->offset[i] != GST_VIDEO_INFO_PLANE_OFFSET(&(output_state->info), i)) || (video_meta->stride[i] != GST_VIDEO_INFO_PLANE_STRIDE(&(output_state->info), i)))
+			copy_needed = TRUE;
+	}
+
+	if (!copy_needed)
+	{
+		gst_video_codec_state_unref(output_state);
+		return TRUE;
+	}
+
+	GST_CAT_INFO_OBJECT(GST_CAT_PERFORMANCE, vmeta_dec, "downstream supports neither video nor crop metas; copying the displayed part of the picture");
+
+	cropped_buffer = gst_buffer_new_allocate(NULL, GST_VIDEO_INFO_SIZE(&(output_state->info)), NULL);
+	copied = FALSE;
+	if ((cropped_buffer != NULL) && gst_video_frame_map(&src_frame, &(output_state->info), *picture_buffer, GST_MAP_READ))
+	{
+		if (gst_video_frame_map(&dest_frame, &(output_state->info), cropped_buffer, GST_MAP_WRITE))
+		{
+			copied = gst_video_frame_copy(&dest_frame, &src_frame);
+			gst_video_frame_unmap(&dest_frame);
+		}
+		gst_video_frame_unmap(&src_frame);
+	}
+
+	gst_video_codec_state_unref(output_state);
+
+	if (!copied)
+	{
+		GST_ERROR_OBJECT(vmeta_dec, "could not copy the displayed part of the picture");
+		if (cropped_buffer != NULL)
+			gst_buffer_unref(cropped_buffer);
+		return FALSE;
+	}
+
+	/* The picture goes back to the pool right away */
+	gst_buffer_copy_into(cropped_buffer, *picture_buffer, GST_BUFFER_COPY_FLAGS | GST_BUFFER_COPY_TIMESTAMPS, 0, -1);
+	gst_buffer_unref(*picture_buffer);
+	*picture_buffer = cropped_buffer;
+
+	return TRUE;
+}
+
+
+
+
+/**********************/
+/* decoding functions */
+
+static GstFlowReturn gst_vmeta_dec_collect_nal_units(GstVmetaDec *vmeta_dec, GstVideoCodecFrame *frame, GstAdapter *adapter, gboolean at_eos)
+{
+	guint8 header[4];
+	gsize available, nal_size, header_offset, header_size;
+	GstVmetaUnitFlags unit_flags;
+	guint i, nal_length_size;
+	GstVideoDecoder *decoder = GST_VIDEO_DECODER(vmeta_dec);
+
+	/* Used with NAL-aligned h.264 input. The NAL units are added to the frame until one of them
+	 * begins the next access unit. Every input buffer contains complete NAL units, so the
+	 * adapter never ends with a partial one. */
+
+	nal_length_size = vmeta_dec->bitstream_parser.h264_nal_length_size;
+
+	while ((available = gst_adapter_available(adapter)) > 0)
+	{
+		if (nal_length_size > 0)
+		{
+			if (available < nal_length_size)
+				break;
+
+			gst_adapter_copy(adapter, header, 0, nal_length_size);
+			nal_size = 0;
+			for (i = 0; i < nal_length_size; ++i)
+				nal_size = (nal_size << 8) | header[i];
+
+			header_offset = nal_length_size;
+			nal_size = MIN(nal_length_size + nal_size, available);
+		}
+		else
+		{
+			gssize start, next;
+
+			/* The NAL unit extends up to the next start code, or to the end of the data */
+			start = (available >= 4) ? gst_adapter_masked_scan_uint32(adapter, 0xffffff00, 0x00000100, 0, available) : -1;
+			header_offset = (start >= 0) ? (gsize)(start + 3) : 0;
+			next = ((header_offset + 4) <= available) ? gst_adapter_masked_scan_uint32(adapter, 0xffffff00, 0x00000100, header_offset, available - header_offset) : -1;
+			nal_size = (next >= 0) ? (gsize)next : available;
+		}
+
+		/* The NAL header and the first byte of a slice header are enough to find access unit boundaries */
+		header_size = (nal_size > header_offset) ? MIN(nal_size - header_offset, 2) : 0;
+		if (header_size > 0)
+			gst_adapter_copy(adapter, header, header_offset, header_size);
+		unit_flags = gst_vmeta_bitstream_get_unit_flags(IPP_VIDEO_STRM_FMT_H264, header, header_size);
+
+		if ((unit_flags & GST_VMETA_UNIT_FLAG_AU_START) && vmeta_dec->au_has_picture)
+		{
+			vmeta_dec->au_has_picture = FALSE;
+			return gst_video_decoder_have_frame(decoder);
+		}
+
+		if (unit_flags & GST_VMETA_UNIT_FLAG_PICTURE)
+			vmeta_dec->au_has_picture = TRUE;
+		if (unit_flags & GST_VMETA_UNIT_FLAG_KEY)
+			GST_VIDEO_CODEC_FRAME_SET_SYNC_POINT(frame);
+
+		gst_video_decoder_add_to_frame(decoder, nal_size);
+	}
+
+	if (at_eos && vmeta_dec->au_has_picture)
+	{
+		vmeta_dec->au_has_picture = FALSE;
+		return gst_video_decoder_have_frame(decoder);
+	}
+
+	return GST_VIDEO_DECODER_FLOW_NEED_DATA;
+}
+
+
+static GstFlowReturn gst_vmeta_dec_assemble_au(GstVmetaDec *vmeta_dec, GstVideoCodecFrame *frame, GstAdapter *adapter, gboolean at_eos)
+{
+	gsize available, map_size, num_checked, offset;
+	guint8 const *data;
+	GstVmetaUnitFlags unit_flags;
+	GstVideoDecoder *decoder = GST_VIDEO_DECODER(vmeta_dec);
+
+	/* Used with unparsed input, which consists of arbitrary pieces of the elementary stream. The
+	 * start codes are searched in the input buffers in place, one buffer at a time, and the data
+	 * in front of an access unit boundary is added to the frame. A start code is only evaluated
+	 * once the bytes after it are available; if it is at the end of a buffer, a few bytes of
+	 * the next buffer are needed, and only then does gst_adapter_map() have to copy data. */
+
+	while ((available = gst_adapter_available(adapter)) > 0)
+	{
+		map_size = gst_adapter_available_fast(adapter);
+		if (map_size < UNIT_CONTEXT_SIZE)
+			map_size = MIN(available, UNIT_CONTEXT_SIZE * 2);
+
+		if (map_size < UNIT_CONTEXT_SIZE)
+		{
+			if (!at_eos)
+				break;
+
+			/* No further data follows; the rest belongs to the current access unit */
+			gst_video_decoder_add_to_frame(decoder, available);
+			break;
+		}
+
+		data = gst_adapter_map(adapter, map_size);
+
+		/* Start codes at these offsets can be evaluated; the ones after them are looked at
+		 * again once more data is there */
+		num_checked = map_size - UNIT_CONTEXT_SIZE + 1;
+
+		for (offset = gst_vmeta_bitstream_find_start_code(data, map_size, 0); offset < num_checked; offset = gst_vmeta_bitstream_find_start_code(data, map_size, offset + 3))
+		{
+			unit_flags = gst_vmeta_bitstream_get_unit_flags(vmeta_dec->dec_param_set.strm_fmt, data + offset + 3, GST_VMETA_BITSTREAM_UNIT_HEADER_SIZE);
+
+			if ((unit_flags & GST_VMETA_UNIT_FLAG_AU_START) && vmeta_dec->au_has_picture)
+			{
+				gst_adapter_unmap(adapter);
+				if (offset > 0)
+					gst_video_decoder_add_to_frame(decoder, offset);
+
+				vmeta_dec->au_has_picture = FALSE;
+				return gst_video_decoder_have_frame(decoder);
+			}
+
+			if (unit_flags & GST_VMETA_UNIT_FLAG_PICTURE)
+				vmeta_dec->au_has_picture = TRUE;
+			if (unit_flags & GST_VMETA_UNIT_FLAG_KEY)
+				GST_VIDEO_CODEC_FRAME_SET_SYNC_POINT(frame);
+		}
+
+		gst_adapter_unmap(adapter);
+		gst_video_decoder_add_to_frame(decoder, num_checked);
+	}
+
+	if (at_eos && vmeta_dec->au_has_picture)
+	{
+		vmeta_dec->au_has_picture = FALSE;
+		return gst_video_decoder_have_frame(decoder);
+	}
+
+	return GST_VIDEO_DECODER_FLOW_NEED_DATA;
+}
+
+
+static GstFlowReturn gst_vmeta_dec_upload_frame(GstVmetaDec *vmeta_dec, GstVideoCodecFrame *frame)
+{
+	gboolean copy_ok;
+	IppVmetaBitstream *stream;
+	GstFlowReturn flow_ret;
+
+	gst_vmeta_dec_record_au_size(vmeta_dec, gst_buffer_get_size(frame->input_buffer));
+
+	flow_ret = gst_vmeta_dec_acquire_stream(vmeta_dec, &stream);
+	if (flow_ret != GST_FLOW_OK)
+		return flow_ret;
+
+	/* If the input buffer already lives in vMeta DMA memory (for example, because
+	 * upstream uses the pool offered in propose_allocation), no copy is necessary */
+	if (gst_vmeta_dec_wrap_input_buffer(vmeta_dec, stream, frame->input_buffer))
+		copy_ok = TRUE;
+	else
+		copy_ok = gst_vmeta_dec_copy_to_stream(vmeta_dec, stream, frame->input_buffer);
+
+	gst_vmeta_dec_release_stream(vmeta_dec, stream, copy_ok);
+
+	if (!copy_ok)
+	{
+		GST_ERROR_OBJECT(vmeta_dec, "failed to upload input data to stream buffer");
+		return GST_FLOW_ERROR;
+	}
+
+	return GST_FLOW_OK;
+}
+
+
+static GstFlowReturn gst_vmeta_dec_push_output_pictures(GstVmetaDec *vmeta_dec, gboolean may_block)
+{
+	IppCodecStatus ret;
+	IppVmetaPicture *picture;
+	GstBuffer *picture_buffer;
+	GstBufferPool *pool = NULL;
+	GstBufferPoolAcquireParams params;
+	guint num_required_pictures, num_pushed = 0;
+	GstVideoDecoder *decoder = GST_VIDEO_DECODER(vmeta_dec);
+
+	/* Called by the decode loop, with the engine acquired. Pushes output pictures until the engine
+	 * has as many as it requires. If may_block is TRUE, the first picture is allocated normally, which
+	 * may block until downstream returns one (the engine cannot continue without it anyway). All other
+	 * pictures are only taken from the pool if it has them available right now, since the engine can
+	 * continue without them, and blocking here would hold back decoding for no reason. */
+
+	num_required_pictures = gst_vmeta_dec_get_num_required_pictures(vmeta_dec);
+	memset(&params, 0, sizeof(params));
+	params.flags = GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT;
+
+	/* If the engine asked for a picture, it gets at least one, even if it seemingly
+	 * has enough already (it may need more than it reported) */
+	while ((may_block && (num_pushed == 0)) || (vmeta_dec->num_engine_pictures < num_required_pictures))
+	{
+		if (may_block && (num_pushed == 0))
+		{
+			picture_buffer = gst_video_decoder_allocate_output_buffer(decoder);
+			if (picture_buffer == NULL)
+			{
+				GST_ERROR_OBJECT(vmeta_dec, "could not allocate output picture buffer");
+				return GST_FLOW_ERROR;
+			}
+		}
+		else
+		{
+			/* The pool is only retrieved here, after the blocking allocation above
+			 * had a chance to negotiate and to activate it */
+			if (pool == NULL)
+			{
+				pool = gst_video_decoder_get_buffer_pool(decoder);
+				if (pool == NULL)
+					break;
+			}
+
+			if (gst_buffer_pool_acquire_buffer(pool, &picture_buffer, &params) != GST_FLOW_OK)
+				break;
+		}
+
+		picture = gst_vmeta_dec_get_ipp_picture_from_buffer(vmeta_dec, picture_buffer);
+		if (picture == NULL)
+		{
+			gst_buffer_unref(picture_buffer);
+			if (pool != NULL)
+				gst_object_unref(pool);
+			return GST_FLOW_ERROR;
+		}
+
+		GST_LOG_OBJECT(vmeta_dec, "pushing picture: %p", picture);
+
+		ret = DecoderPushBuffer_Vmeta(IPP_VMETA_BUF_TYPE_PIC, picture, vmeta_dec->dec_state);
+		if (ret != IPP_STATUS_NOERR)
+		{
+			GST_ERROR_OBJECT(vmeta_dec, "pushing picture failed : %s", gst_vmeta_dec_strstatus(ret));
+			gst_buffer_unref(picture_buffer);
+			if (pool != NULL)
+				gst_object_unref(pool);
+			return GST_FLOW_ERROR;
+		}
+
+		++vmeta_dec->num_engine_pictures;
+		++num_pushed;
+	}
+
+	if (pool != NULL)
+		gst_object_unref(pool);
+
+	if (num_pushed > 0)
+		GST_LOG_OBJECT(vmeta_dec, "pushed %u picture(s); engine has %u of %u required picture(s)", num_pushed, vmeta_dec->num_engine_pictures, num_required_pictures);
+
+	return GST_FLOW_OK;
+}
+
+
+static GstFlowReturn gst_vmeta_dec_output_picture(GstVmetaDec *vmeta_dec, GstBuffer *picture_buffer)
+{
+	GstVideoCodecFrame *frame;
+	GstFlowReturn flow_ret;
+	GstVideoDecoder *decoder = GST_VIDEO_DECODER(vmeta_dec);
+
+	GST_VIDEO_DECODER_STREAM_LOCK(decoder);
+
+	/* More pictures than frames were decoded so far; keep this one for the next frame */
+	if (vmeta_dec->num_expected_pictures == 0)
+	{
+		flow_ret = gst_vmeta_dec_hold_extra_picture(vmeta_dec, picture_buffer);
+		GST_VIDEO_DECODER_STREAM_UNLOCK(decoder);
+		return flow_ret;
+	}
+
+	--vmeta_dec->num_expected_pictures;
+
+	/* The engine outputs pictures in display order, and the frames are in decoding order;
+	 * the base class reorders the timestamps, so the picture belongs to the oldest frame */
+	frame = gst_video_decoder_get_oldest_frame(decoder);
+	if ((frame != NULL) && !gst_vmeta_dec_crop_picture(vmeta_dec, &picture_buffer))
+	{
+		gst_buffer_unref(picture_buffer);
+		gst_video_decoder_release_frame(decoder, frame);
+		GST_VIDEO_DECODER_STREAM_UNLOCK(decoder);
+		return GST_FLOW_ERROR;
+	}
+
+	if (frame != NULL)
+	{
+		frame->output_buffer = picture_buffer;
+
+		/* finish_frame may correct the timestamps, so read them afterwards; they
+		 * are the base for interpolating the timestamps of extra pictures */
+		GST_OBJECT_LOCK(vmeta_dec);
+		++vmeta_dec->num_output_pictures;
+		GST_OBJECT_UNLOCK(vmeta_dec);
+
+		gst_video_codec_frame_ref(frame);
+		flow_ret = gst_video_decoder_finish_frame(decoder, frame);
+		vmeta_dec->frames_finished = TRUE;
+		vmeta_dec->last_output_pts = frame->pts;
+		vmeta_dec->last_output_duration = frame->duration;
+		gst_video_codec_frame_unref(frame);
+	}
+	else
+	{
+		GST_DEBUG_OBJECT(vmeta_dec, "no pending frame for decoded picture - dropping picture");
+		gst_buffer_unref(picture_buffer);
+		flow_ret = GST_FLOW_OK;
+	}
+
+	GST_VIDEO_DECODER_STREAM_UNLOCK(decoder);
+
+	return flow_ret;
+}
+
+
+static GstFlowReturn gst_vmeta_dec_hold_extra_picture(GstVmetaDec *vmeta_dec, GstBuffer *picture_buffer)
+{
+	GstFlowReturn flow_ret = GST_FLOW_OK;
+
+	/* Must be called with the stream lock held. The engine sometimes outputs more pictures
+	 * than frames were pushed: an MPEG-4 packed bitstream frame contains a P- and a B-picture,
+	 * followed by a frame with a placeholder (N-VOP) which produces none, and field or MVC
+	 * content can produce two pictures per frame. The extra picture is associated with the
+	 * next frame, which takes care of the packed bitstream case. */
+
+	/* During reverse playback, the base class reverses the pictures of each GOP, which
+	 * only works for pictures that went through finish_frame; pushing extra pictures
+	 * directly would put them out of order */
+	if (vmeta_dec->reverse_playback)
+	{
+		GST_DEBUG_OBJECT(vmeta_dec, "reverse playback: dropping extra picture");
+		gst_buffer_unref(picture_buffer);
+		return GST_FLOW_OK;
+	}
+
+	/* Only one picture is held back; an older one is pushed now */
+	if (vmeta_dec->held_picture != NULL)
+		flow_ret = gst_vmeta_dec_push_held_picture(vmeta_dec);
+
+	GST_LOG_OBJECT(vmeta_dec, "holding extra picture %p until the next frame", (gpointer)picture_buffer);
+	vmeta_dec->held_picture = picture_buffer;
+
+	return flow_ret;
+}
+
+
+static GstFlowReturn gst_vmeta_dec_output_held_picture(GstVmetaDec *vmeta_dec)
+{
+	GstBuffer *picture_buffer;
+	GstFlowReturn flow_ret;
+
+	/* Called by the decode loop, with the engine acquired, after a stream was pushed
+	 * to the engine; this frame gets the held picture. The engine is released while
+	 * the picture is pushed downstream, as with completed pictures. */
+	picture_buffer = vmeta_dec->held_picture;
+	if (picture_buffer == NULL)
+		return GST_FLOW_OK;
+
+	vmeta_dec->held_picture = NULL;
+
+	gst_vmeta_scheduler_release(vmeta_dec->scheduler_client);
+	flow_ret = gst_vmeta_dec_output_picture(vmeta_dec, picture_buffer);
+	gst_vmeta_scheduler_acquire(vmeta_dec->scheduler_client);
+
+	return flow_ret;
+}
+
+
+static GstFlowReturn gst_vmeta_dec_push_held_picture(GstVmetaDec *vmeta_dec)
+{
+	GstBuffer *picture_buffer = vmeta_dec->held_picture;
+
+	/* Must be called with the stream lock held */
+	if (picture_buffer == NULL)
+		return GST_FLOW_OK;
+
+	vmeta_dec->held_picture = NULL;
+
+	return gst_vmeta_dec_push_extra_picture(vmeta_dec, picture_buffer);
+}
+
+
+static GstFlowReturn gst_vmeta_dec_push_extra_picture(GstVmetaDec *vmeta_dec, GstBuffer *picture_buffer)
+{
+	GstClockTime duration = vmeta_dec->last_output_duration;
+	guint64 clipped_start, clipped_stop;
+	GstVideoDecoder *decoder = GST_VIDEO_DECODER(vmeta_dec);
+
+	/* Must be called with the stream lock held. There is no frame for this picture, and the
+	 * base class offers no way to create one, so it bypasses finish_frame; its timestamp
+	 * continues where the previous picture ended. */
+
+	/* finish_frame pushes the base class' pending events (caps, segment, tags) before the
+	 * first picture; until a picture went through it, nothing may be pushed directly */
+	if (!vmeta_dec->frames_finished)
+	{
+		GST_DEBUG_OBJECT(vmeta_dec, "no picture was finished since the last flush; dropping extra picture");
+		gst_buffer_unref(picture_buffer);
+		return GST_FLOW_OK;
+	}
+
+	if (!gst_vmeta_dec_crop_picture(vmeta_dec, &picture_buffer))
+	{
+		gst_buffer_unref(picture_buffer);
+		return GST_FLOW_ERROR;
+	}
+
+	if (!GST_CLOCK_TIME_IS_VALID(duration))
+	{
+		GstVideoCodecState *state = gst_video_decoder_get_output_state(decoder);
+		if (state != NULL)
+		{
+			if (state->info.fps_n > 0)
+				duration = gst_util_uint64_scale_int(GST_SECOND, state->info.fps_d, state->info.fps_n);
+			gst_video_codec_state_unref(state);
+		}
 	}
+
+	if (GST_CLOCK_TIME_IS_VALID(vmeta_dec->last_output_pts) && GST_CLOCK_TIME_IS_VALID(duration))
+		vmeta_dec->last_output_pts += duration;
 	else
+		vmeta_dec->last_output_pts = GST_CLOCK_TIME_NONE;
+	vmeta_dec->last_output_duration = duration;
+
+	GST_BUFFER_PTS(picture_buffer) = vmeta_dec->last_output_pts;
+	GST_BUFFER_DTS(picture_buffer) = GST_CLOCK_TIME_NONE;
+	GST_BUFFER_DURATION(picture_buffer) = duration;
+
+	/* Clip against the output segment, like finish_frame does */
+	if ((decoder->output_segment.format == GST_FORMAT_TIME) && GST_CLOCK_TIME_IS_VALID(vmeta_dec->last_output_pts))
+	{
+		guint64 stop = GST_CLOCK_TIME_IS_VALID(duration) ? (vmeta_dec->last_output_pts + duration) : GST_CLOCK_TIME_NONE;
+
+		if (!gst_segment_clip(&(decoder->output_segment), GST_FORMAT_TIME, vmeta_dec->last_output_pts, stop, &clipped_start, &clipped_stop))
+		{
+			GST_DEBUG_OBJECT(vmeta_dec, "extra picture with timestamp %" GST_TIME_FORMAT " is outside of the segment; dropping it", GST_TIME_ARGS(vmeta_dec->last_output_pts));
+			gst_buffer_unref(picture_buffer);
+			return GST_FLOW_OK;
+		}
+
+		GST_BUFFER_PTS(picture_buffer) = clipped_start;
+		if (GST_CLOCK_TIME_IS_VALID(stop))
+			GST_BUFFER_DURATION(picture_buffer) = clipped_stop - clipped_start;
+	}
+
+	GST_LOG_OBJECT(vmeta_dec, "pushing extra picture with timestamp %" GST_TIME_FORMAT, GST_TIME_ARGS(vmeta_dec->last_output_pts));
+
+	GST_OBJECT_LOCK(vmeta_dec);
+	++vmeta_dec->num_output_pictures;
+	GST_OBJECT_UNLOCK(vmeta_dec);
+
+	return gst_pad_push(GST_VIDEO_DECODER_SRC_PAD(decoder), picture_buffer);
+}
+
+
+static GstFlowReturn gst_vmeta_dec_handle_new_sequence(GstVmetaDec *vmeta_dec)
+{
+	GstVideoDecoder *decoder = GST_VIDEO_DECODER(vmeta_dec);
+	IppVmetaDecSeqInfo *seq_info = &(vmeta_dec->dec_info.seq_info);
+	GstVideoCodecState *output_state;
+	guint width, height;
+	gboolean negotiated;
+
+	width = seq_info->picROI.width;
+	height = seq_info->picROI.height;
+
+	GST_DEBUG_OBJECT(vmeta_dec, "new sequence:  size: %ux%u  dis stride: %u  dis buf size: %u", width, height, seq_info->dis_stride, seq_info->dis_buf_size);
+
+	if ((width == 0) || (height == 0))
+		return GST_FLOW_OK;
+
+	GST_VIDEO_DECODER_STREAM_LOCK(decoder);
+
+	/* If the size did not change, nothing needs to be done; a negotiation
+	 * happens anyway when the first output picture is allocated */
+	output_state = gst_video_decoder_get_output_state(decoder);
+	if ((output_state == NULL) || ((guint)(output_state->info.width) == width && (guint)(output_state->info.height) == height))
+	{
+		if (output_state != NULL)
+			gst_video_codec_state_unref(output_state);
+		GST_VIDEO_DECODER_STREAM_UNLOCK(decoder);
+		return GST_FLOW_OK;
+	}
+
+	GST_INFO_OBJECT(vmeta_dec, "resolution changed from %dx%d to %ux%u", output_state->info.width, output_state->info.height, width, height);
+
+	/* Renegotiate right away; decide_allocation keeps the current
+	 * pictures if their DMA buffers are large enough */
+	gst_video_codec_state_unref(gst_vmeta_dec_set_output_state(vmeta_dec, width, height, output_state));
+	gst_video_codec_state_unref(output_state);
+	negotiated = gst_video_decoder_negotiate(decoder);
+
+	GST_VIDEO_DECODER_STREAM_UNLOCK(decoder);
+
+	if (!negotiated)
+	{
+		GST_ERROR_OBJECT(vmeta_dec, "could not negotiate output for the new sequence");
+		return GST_FLOW_NOT_NEGOTIATED;
+	}
+
+	return GST_FLOW_OK;
+}
+
+
+static GstFlowReturn gst_vmeta_dec_decode_loop(GstVmetaDec *vmeta_dec)
+{
+	GstFlowReturn flow_ret;
+
+	/* Several decoders in this process may share the video engine. The engine is
+	 * acquired for as long as the loop drives it, and released at frame boundaries
+	 * (see gst_vmeta_dec_run_decode_loop()), so other decoders get their turn. */
+	gst_vmeta_scheduler_acquire(vmeta_dec->scheduler_client);
+	flow_ret = gst_vmeta_dec_run_decode_loop(vmeta_dec);
+	gst_vmeta_scheduler_release(vmeta_dec->scheduler_client);
+
+	return flow_ret;
+}
+
+
+static GstFlowReturn gst_vmeta_dec_run_decode_loop(GstVmetaDec *vmeta_dec)
+{
+	IppCodecStatus ret;
+	IppVmetaBitstream *stream;
+	IppVmetaPicture *picture;
+	GstFlowReturn flow_ret;
+	guint num_consecutive_waits = 0, input_queue_depth;
+	gint64 wait_start_time = 0, decode_timeout;
+
+
+	/* The code in here orients itself towards the IPP_STATUS_NEED_INPUT status codes.
+	 * Every time IPP_STATUS_NEED_INPUT is returned by DecodeFrame_Vmeta(), the next stream from
+	 * the "streams_ready" queue is pushed to the video engine. Then, the loop continues.
+	 * During the loops, the decoder may request pictures, and return completed pictures.
+	 * If more completed pictures are returned than frames were pushed, the extra ones are
+	 * held back for the next frame (see gst_vmeta_dec_hold_extra_picture()).
+	 * The looping continues until either EOS or an error is reported, or IPP_STATUS_NEED_INPUT
+	 * is returned and no stream is ready. Looping stops then.
+	 *
+	 * The idea behind this is that the loop is "input-oriented", that is, every time it is run,
+	 * it means there is new input data to decode. So the code inside here does as much as possible
+	 * with the input data until the video engine is done with it and requires new input data.
+	 * In the synchronous mode, the loop is run by handle_frame, with exactly one ready stream.
+	 * In decode thread mode, it is run by the decode thread whenever streams are ready.
+	 *
+	 * The upload_before_loop boolean is tied to this. Initially, it is set to FALSE.
+	 * The very first time the loop is run, DecodeFrame_Vmeta() has not been called yet.
+	 * Then, in the first loop, DecodeFrame_Vmeta() is called, IPP_STATUS_NEED_INPUT is returned the
+	 * first time. The input data is pushed to the video engine, the loop does all it can, until the
+	 * second IPP_STATUS_NEED_INPUT status code is returned, and no stream is ready. upload_before_loop
+	 * is set to TRUE, and the loop exits.
+	 * The next time the loop is run, upload_before_loop is TRUE, and the loop immediately
+	 * pushes the input data to the video engine, effectively omitting the first IPP_STATUS_NEED_INPUT
+	 * status code. This means upload_before_loop is FALSE only before the first loop, and TRUE
+	 * afterwards. This mechanism prevents unnecessary DecodeFrame_Vmeta() calls.
+	 */
+
+
+	/* The decode timeout is converted to microseconds here, to compare it against g_get_monotonic_time() */
+	GST_OBJECT_LOCK(vmeta_dec);
+	decode_timeout = (gint64)(vmeta_dec->decode_timeout) * 1000;
+	input_queue_depth = vmeta_dec->input_queue_depth;
+	GST_OBJECT_UNLOCK(vmeta_dec);
+
+	if (vmeta_dec->upload_before_loop)
+	{
+		stream = gst_vmeta_dec_pop_ready_stream(vmeta_dec);
+		if (stream == NULL)
+			return GST_FLOW_OK;
+
+		if (!gst_vmeta_dec_push_stream(vmeta_dec, stream))
+			return GST_FLOW_ERROR;
+
+		flow_ret = gst_vmeta_dec_output_held_picture(vmeta_dec);
+		if (flow_ret != GST_FLOW_OK)
+			return flow_ret;
+
+		flow_ret = gst_vmeta_dec_push_queued_streams(vmeta_dec, input_queue_depth);
+		if (flow_ret != GST_FLOW_OK)
+			return flow_ret;
+	}
+
+	while (TRUE)
+	{
+		/* In decode thread mode, stop early if the thread is being shut down */
+		if (g_atomic_int_get(&(vmeta_dec->decode_thread_stop)))
+			return GST_FLOW_FLUSHING;
+
+		ret = DecodeFrame_Vmeta(&(vmeta_dec->dec_info), vmeta_dec->dec_state);
+		GST_LOG_OBJECT(vmeta_dec, "DecodeFrame_Vmeta() returned code %d (%s)", (gint)(ret), gst_vmeta_dec_strstatus(ret));
+
+		GST_OBJECT_LOCK(vmeta_dec);
+		++vmeta_dec->num_decode_calls;
+		GST_OBJECT_UNLOCK(vmeta_dec);
+
+		if (ret != IPP_STATUS_WAIT_FOR_EVENT)
+			num_consecutive_waits = 0;
+
+		switch (ret)
+		{
+			/* TODO:
+			 * there are two status codes, IPP_STATUS_END_OF_PICTURE and
+			 * IPP_STATUS_END_OF_STREAM , which never ever are returned by the
+			 * DecodeFrame_Vmeta() function. What are these? */
+
+			case IPP_STATUS_NEED_INPUT:
+			{
+				/* if there is no more input data, exit, and wait until new input
+				 * is ready; the block before the main loop then uploads the input */
+				stream = gst_vmeta_dec_pop_ready_stream(vmeta_dec);
+				if (stream == NULL)
+					return GST_FLOW_OK;
+
+				if (!gst_vmeta_dec_push_stream(vmeta_dec, stream))
+					return GST_FLOW_ERROR;
+
+				flow_ret = gst_vmeta_dec_output_held_picture(vmeta_dec);
+				if (flow_ret != GST_FLOW_OK)
+					return flow_ret;
+
+				flow_ret = gst_vmeta_dec_push_queued_streams(vmeta_dec, input_queue_depth);
+				if (flow_ret != GST_FLOW_OK)
+					return flow_ret;
+
+				break;
+			}
+			case IPP_STATUS_RETURN_INPUT_BUF:
+			{
+				if (!gst_vmeta_dec_return_stream_buffers(vmeta_dec))
+					return GST_FLOW_ERROR;
+				break;
+			}
+			case IPP_STATUS_FRAME_COMPLETE:
+			{
+				GstBuffer *picture_buffer = NULL;
+
+				ret = DecoderPopBuffer_Vmeta(IPP_VMETA_BUF_TYPE_PIC, (void **)(&picture), vmeta_dec->dec_state);
+				if (ret != IPP_STATUS_NOERR)
+				{
+					GST_ERROR_OBJECT(vmeta_dec, "failed to pop picture : %s", gst_vmeta_dec_strstatus(ret));
+					return GST_FLOW_ERROR;
+				}
+
+				/* DecoderPopBuffer_Vmeta() sometimes returns NULL after a completed frame.
+				 * When this happens, this NULL frame has to be ignored. Return stream buffers
+				 * and suspend-resume as usual, but that's it. The next frame returns non-NULL. */
+				if (picture != NULL)
+				{
+					if (vmeta_dec->num_engine_pictures > 0)
+						--vmeta_dec->num_engine_pictures;
+
+					GST_LOG_OBJECT(vmeta_dec, "pic type: %u coded type: %d %d poc: %d %d offset: %u datalen: %u bufsize: %u", picture->PicDataInfo.pic_type, picture->PicDataInfo.coded_type[0], picture->PicDataInfo.coded_type[1], picture->PicDataInfo.poc[0], picture->PicDataInfo.poc[1], picture->nOffset, picture->nDataLen, picture->nBufSize);
+
+					picture_buffer = gst_vmeta_dec_get_buffer_from_ipp_picture(vmeta_dec, picture);
+					if (picture_buffer == NULL)
+					{
+						GST_ERROR_OBJECT(vmeta_dec, "IPP picture %p is not associated with a gstreamer buffer", picture);
+						return GST_FLOW_ERROR;
+					}
+
+					GST_LOG_OBJECT(vmeta_dec, "popped picture %p (gstreamer buffer %p)", picture, picture_buffer);
+				}
+				else
+					GST_LOG_OBJECT(vmeta_dec, "popped NULL picture");
+
+				/* Return the streams before finishing the frame, since finishing
+				 * may block, and handle_frame may be waiting for a stream */
+				if (!gst_vmeta_dec_return_stream_buffers(vmeta_dec))
+				{
+					if (picture_buffer != NULL)
+						gst_buffer_unref(picture_buffer);
+					return GST_FLOW_ERROR;
+				}
+
+				if (!gst_vmeta_dec_suspend_and_resume(vmeta_dec))
+				{
+					if (picture_buffer != NULL)
+						gst_buffer_unref(picture_buffer);
+					return GST_FLOW_ERROR;
+				}
+
+				if (picture_buffer != NULL)
+				{
+					/* Frame boundary: let other decoders use the engine while the
+					 * picture is pushed downstream, which may block */
+					gst_vmeta_scheduler_release(vmeta_dec->scheduler_client);
+					flow_ret = gst_vmeta_dec_output_picture(vmeta_dec, picture_buffer);
+					gst_vmeta_scheduler_acquire(vmeta_dec->scheduler_client);
+
+					if (flow_ret != GST_FLOW_OK)
+						return flow_ret;
+
+					/* Replace the picture which just left the engine if one is available right
+					 * away, so the engine does not have to ask for it with NEED_OUTPUT_BUF */
+					flow_ret = gst_vmeta_dec_push_output_pictures(vmeta_dec, FALSE);
+					if (flow_ret != GST_FLOW_OK)
+						return flow_ret;
+				}
+
+				break;
+			}
+			case IPP_STATUS_NEED_OUTPUT_BUF:
+			{
+				flow_ret = gst_vmeta_dec_push_output_pictures(vmeta_dec, TRUE);
+				if (flow_ret != GST_FLOW_OK)
+					return flow_ret;
+
+				break;
+			}
+			case IPP_STATUS_NEW_VIDEO_SEQ:
+			{
+				/* When a new sequence is started, pull all pictures from the video
+				 * engine; completed ones have already been processed before anyway */
+				if (!gst_vmeta_dec_return_picture_buffers(vmeta_dec))
+					return GST_FLOW_ERROR;
+
+				flow_ret = gst_vmeta_dec_handle_new_sequence(vmeta_dec);
+				if (flow_ret != GST_FLOW_OK)
+					return flow_ret;
+
+				break;
+			}
+			case IPP_STATUS_END_OF_STREAM:
+			{
+				GST_DEBUG_OBJECT(vmeta_dec, "end of stream reached");
+
+				/* TODO: There is a VC1 start code for end-of-sequence.
+				 * It is unclear if this has to be sent to vMeta, or if it is optional,
+				 * or if the data already contains it.
+				 * The marvell plugins for GStreamer 0.10 seem to send it under some
+				 * conditions. Omitting it here for now (decoder shutdown works fine
+				 * without it). */
+
+				return GST_FLOW_EOS;
+			}
+			case IPP_STATUS_WAIT_FOR_EVENT:
+			{
+				/* The engine is still busy; do not poll it. If it stays busy for
+				 * longer than the decode timeout, it hung. */
+				gint64 wait_duration;
+
+				if (num_consecutive_waits == 0)
+					wait_start_time = g_get_monotonic_time();
+
+				wait_duration = g_get_monotonic_time() - wait_start_time;
+				if ((decode_timeout > 0) && (wait_duration > decode_timeout))
+				{
+					GST_ERROR_OBJECT(vmeta_dec, "video engine did not finish decoding within %" G_GINT64_FORMAT " ms; it hung", decode_timeout / 1000);
+					vmeta_dec->hang_stall_time = (GstClockTime)wait_duration * GST_USECOND;
+					return GST_VMETA_DEC_FLOW_HANG;
+				}
+
+				/* In decode thread mode, more streams may have become ready in the meantime */
+				flow_ret = gst_vmeta_dec_push_queued_streams(vmeta_dec, input_queue_depth);
+				if (flow_ret != GST_FLOW_OK)
+					return flow_ret;
+
+				gst_vmeta_dec_wait_for_engine(vmeta_dec, num_consecutive_waits++);
+				break;
+			}
+			case IPP_STATUS_FRAME_ERR:
+			case IPP_STATUS_FRAME_HEADER_INVALID:
+			case IPP_STATUS_BITSTREAM_ERR:
+			case IPP_STATUS_SYNCNOTFOUND_ERR:
+			{
+				/* The engine carries on, but the following pictures would be predicted from
+				 * a corrupted one; handle_frame discards them until the next keyframe */
+				if (!g_atomic_int_get(&(vmeta_dec->error_recovery)))
+					GST_WARNING_OBJECT(vmeta_dec, "decoding error (%s); resynchronizing at the next keyframe", gst_vmeta_dec_strstatus(ret));
+				g_atomic_int_set(&(vmeta_dec->error_recovery), TRUE);
+				break;
+			}
+			default:
+			{
+				GST_DEBUG_OBJECT(vmeta_dec, "DecodeFrame_Vmeta() returned unhandled code %d (%s)", (gint)(ret), gst_vmeta_dec_strstatus(ret));
+			}
+		}
+	}
+}
+
+
+static void gst_vmeta_dec_wait_for_engine(GstVmetaDec *vmeta_dec, G_GNUC_UNUSED guint num_consecutive_waits)
+{
+	gint64 start_time = g_get_monotonic_time();
+	gint64 end_time;
+
+#ifdef HAVE_VDEC_OS_SYNC_EVENT
+	/* Block until the engine signals the completion; the consecutive waits do not matter then */
+	if (vdec_os_api_sync_event() < 0)
+	{
+		GST_LOG_OBJECT(vmeta_dec, "waiting for the engine event failed; sleeping instead");
+		g_usleep(WAIT_MAX_SLEEP_US);
+	}
+#else
+	/* Without a completion event, back off exponentially, so short decoding
+	 * times are not overslept, and long ones do not keep the CPU busy */
+	g_usleep(MIN((gulong)WAIT_MIN_SLEEP_US << MIN(num_consecutive_waits, 16u), (gulong)WAIT_MAX_SLEEP_US));
+#endif
+
+	end_time = g_get_monotonic_time();
+
+	GST_OBJECT_LOCK(vmeta_dec);
+	++vmeta_dec->num_engine_waits;
+	vmeta_dec->engine_wait_time += (GstClockTime)(end_time - start_time) * GST_USECOND;
+	GST_OBJECT_UNLOCK(vmeta_dec);
+}
+
+
+static gboolean gst_vmeta_dec_get_picture_flags(GstVmetaDec *vmeta_dec, GstVideoCodecFrame *frame, GstVmetaPictureFlags *flags)
+{
+	GstMemory *mem;
+	GstMapInfo map_info;
+	gboolean flags_known;
+
+	/* The picture headers are at the start of the access unit, so only the first memory
+	 * block is mapped; mapping the whole buffer would merge buffers made of several blocks */
+	if (gst_buffer_n_memory(frame->input_buffer) == 0)
+		return FALSE;
+
+	mem = gst_buffer_peek_memory(frame->input_buffer, 0);
+	if (!gst_memory_map(mem, &map_info, GST_MAP_READ))
+		return FALSE;
+
+	flags_known = gst_vmeta_bitstream_parser_get_picture_flags(&(vmeta_dec->bitstream_parser), map_info.data, map_info.size, flags);
+	gst_memory_unmap(mem, &map_info);
+
+	return flags_known;
+}
+
+
+static gboolean gst_vmeta_dec_qos_drop_frame(GstVmetaDec *vmeta_dec, GstVideoCodecFrame *frame)
+{
+	GstClockTimeDiff deadline;
+	GstClockTime frame_duration;
+	GstVmetaPictureFlags flags;
+	gboolean flags_known;
+
+	deadline = gst_video_decoder_get_max_decode_time(GST_VIDEO_DECODER(vmeta_dec), frame);
+	frame_duration = GST_CLOCK_TIME_IS_VALID(frame->duration) ? frame->duration : QOS_DEFAULT_FRAME_DURATION;
+
+	/* Switch to decoding only keyframes if the pipeline is far behind; switch
+	 * back once frames arrive in time again */
+	if (!vmeta_dec->qos_keyframes_only && (deadline < -(GstClockTimeDiff)(frame_duration * QOS_KEYFRAMES_ONLY_LATENESS)))
+	{
+		GST_DEBUG_OBJECT(vmeta_dec, "pipeline is late by %" GST_STIME_FORMAT "; decoding keyframes only", GST_STIME_ARGS(-deadline));
+		vmeta_dec->qos_keyframes_only = TRUE;
+	}
+	else if (vmeta_dec->qos_keyframes_only && (deadline >= 0))
+	{
+		GST_DEBUG_OBJECT(vmeta_dec, "pipeline caught up; decoding all frames again");
+		vmeta_dec->qos_keyframes_only = FALSE;
+	}
+
+	if (deadline >= 0)
+		return FALSE;
+
+	/* Pending codec_data is prepended to the next uploaded frame, so that frame must not be dropped */
+	if (vmeta_dec->codec_data != NULL)
+		return FALSE;
+
+	/* The picture headers are only inspected if the frame is a candidate for dropping */
+	flags_known = gst_vmeta_dec_get_picture_flags(vmeta_dec, frame, &flags);
+
+	if (!flags_known || (flags & GST_VMETA_PICTURE_FLAG_KEY))
+		return FALSE;
+
+	if (flags & GST_VMETA_PICTURE_FLAG_REFERENCE)
 	{
-		gpointer data = llink->data;
-		*list = g_list_delete_link(*list, llink);
-		return data;
+		/* Reference frames are only dropped once the pipeline is far behind */
+		if (!vmeta_dec->qos_keyframes_only)
+			return FALSE;
+
+		/* Later pictures are predicted from this one, so they cannot be decoded either; skip
+		 * everything up to the next keyframe, and resynchronize there like after a bitstream error */
+		GST_DEBUG_OBJECT(vmeta_dec, "dropping reference frame %u (deadline: %" GST_STIME_FORMAT "); skipping to the next keyframe", frame->system_frame_number, GST_STIME_ARGS(deadline));
+		vmeta_dec->qos_resync = TRUE;
+		g_atomic_int_set(&(vmeta_dec->error_recovery), TRUE);
+		return TRUE;
 	}
+
+	GST_DEBUG_OBJECT(vmeta_dec, "dropping non-reference frame %u (deadline: %" GST_STIME_FORMAT ")", frame->system_frame_number, GST_STIME_ARGS(deadline));
+
+	return TRUE;
 }
 
 
+static gboolean gst_vmeta_dec_is_keyframe(GstVmetaDec *vmeta_dec, GstVideoCodecFrame *frame)
+{
+	GstVmetaPictureFlags flags;
 
+	/* If the picture headers cannot be parsed, rely on upstream's sync point flags */
+	if (gst_vmeta_dec_get_picture_flags(vmeta_dec, frame, &flags))
+		return (flags & GST_VMETA_PICTURE_FLAG_KEY) != 0;
+	else
+		return GST_VIDEO_CODEC_FRAME_IS_SYNC_POINT(frame);
+}
 
-/***************************/
-/* stream buffer functions */
 
-static gboolean gst_vmeta_dec_copy_to_stream(GstVmetaDec *vmeta_dec, IppVmetaBitstream *stream, guint8 *in_data, gsize in_size)
+static GstFlowReturn gst_vmeta_dec_drain(GstVmetaDec *vmeta_dec)
 {
-	unsigned int num_padding, extra_bytes, offset, in_size_total, codec_data_size;
-	gboolean add_vc1_code;
+	IppCodecStatus ret;
+	GstFlowReturn flow_ret;
 
-	extra_bytes = 0;
-	offset = 0;
-	codec_data_size = 0;
+	/* Must be called with the stream lock held. The decode thread has to hand all ready
+	 * streams to the video engine first; it is then stopped, since the engine is driven
+	 * from here while draining. It is restarted by the next handle_frame call. */
+	if (vmeta_dec->decode_thread != NULL)
+	{
+		flow_ret = gst_vmeta_dec_wait_until_streams_decoded(vmeta_dec);
+		if (flow_ret != GST_FLOW_OK)
+			return flow_ret;
 
-	/* the VC1 frame start code is optional, but vMeta requires it.
-	 * In case the input data is a VC1 stream, and there is no frame start code present,
-	 * make room for one.
-	 */
+		gst_vmeta_dec_stop_decode_thread(vmeta_dec, TRUE);
+	}
 
-	add_vc1_code = (vmeta_dec->dec_param_set.strm_fmt == IPP_VIDEO_STRM_FMT_VC1) && ((in_size < 3) || (in_data[0] != 0) || (in_data[1] != 0) || (in_data[2] != 1));
-	if (add_vc1_code)
-		extra_bytes += 4;
+	/* Nothing was pushed to the video engine yet -> nothing to drain */
+	if ((vmeta_dec->dec_state == NULL) || !vmeta_dec->upload_before_loop)
+		return GST_FLOW_OK;
 
-	/* In case there is codec_data, make room for it.
-	 * This is done only for the first frame; afterwards, codec_data is NULL. */
-	if (vmeta_dec->codec_data != NULL)
+	GST_LOG_OBJECT(vmeta_dec, "draining video engine");
+
+	gst_vmeta_scheduler_acquire(vmeta_dec->scheduler_client);
+	ret = DecodeSendCmd_Vmeta(IPPVC_END_OF_STREAM, NULL, NULL, vmeta_dec->dec_state);
+	gst_vmeta_scheduler_release(vmeta_dec->scheduler_client);
+
+	if (ret != IPP_STATUS_NOERR)
 	{
-		codec_data_size = gst_buffer_get_size(vmeta_dec->codec_data);
-		extra_bytes += codec_data_size;
+		GST_ERROR_OBJECT(vmeta_dec, "could not signal end of stream to the video engine: %s", gst_vmeta_dec_strstatus(ret));
+		return GST_FLOW_ERROR;
 	}
 
-	/* Total size for the stream, including extra bytes added above */
-	in_size_total = in_size + extra_bytes;
+	/* The video engine outputs all pictures from its DPB, and then reports the end of stream;
+	 * the first DecodeFrame_Vmeta() call after that requests new input again */
+	vmeta_dec->upload_before_loop = FALSE;
+	flow_ret = gst_vmeta_dec_decode_loop(vmeta_dec);
+	if (flow_ret != GST_FLOW_EOS)
+		return flow_ret;
 
-	GST_DEBUG_OBJECT(vmeta_dec, "VC1 start code: %s", add_vc1_code ? "yes" : "no");
+	/* No frame follows which could take a held picture */
+	return gst_vmeta_dec_push_held_picture(vmeta_dec);
+}
 
-	/* If the stream is not big enough (including padding), enlarge it */
-	if (PADDED_SIZE(in_size_total) > stream->nBufSize)
+
+static guint gst_vmeta_dec_get_reverse_cache_size(GstVmetaDec *vmeta_dec)
+{
+	guint budget;
+	guint picture_size = vmeta_dec->dec_info.seq_info.dis_buf_size;
+
+	/* During reverse playback, the base class keeps the decoded pictures of a GOP until the
+	 * GOP is finished; returns how many of them fit in the reverse cache budget */
+
+	GST_OBJECT_LOCK(vmeta_dec);
+	budget = vmeta_dec->reverse_cache_budget;
+	GST_OBJECT_UNLOCK(vmeta_dec);
+
+	return (picture_size > 0) ? (budget / picture_size) : 0;
+}
+
+
+static gboolean gst_vmeta_dec_reverse_skip_frame(GstVmetaDec *vmeta_dec, GstVideoCodecFrame *frame)
+{
+	GstVideoDecoder *decoder = GST_VIDEO_DECODER(vmeta_dec);
+	gboolean reverse_playback = (decoder->input_segment.rate < 0.0);
+	gboolean keyframes_only;
+	guint cache_size;
+
+	/* Reverse playback needs more output pictures than forward playback (see decide_allocation);
+	 * renegotiate if the direction changed */
+	if (reverse_playback != vmeta_dec->reverse_playback)
 	{
-		/* The stream's DMA buffer size must always be aligned to 64kB boundaries */
-		unsigned int new_buf_size = ALIGN_VAL_TO(in_size_total, 65536) + 65536;
+		GST_DEBUG_OBJECT(vmeta_dec, "switching to %s playback", reverse_playback ? "reverse" : "forward");
 
-		GST_DEBUG_OBJECT(
-			vmeta_dec,
-			"need to stream buffer: necessary stream buffer size: %u  current size: %u",
-			PADDED_SIZE(in_size_total),
-			stream->nBufSize
-		);
+		vmeta_dec->reverse_playback = reverse_playback;
+		vmeta_dec->reverse_keyframes_only = FALSE;
+		vmeta_dec->reverse_gop_length = 0;
+		vmeta_dec->reverse_last_gop_length = 0;
+		vmeta_dec->reverse_num_cached = 0;
 
-		vdec_os_api_dma_free(stream->pBuf);
-		stream->pBuf = vdec_os_api_dma_alloc_writecombine(new_buf_size, VMETA_STRM_BUF_ALIGN, &(stream->nPhyAddr));
-		stream->nBufSize = new_buf_size;
-		stream->nDataLen = 0;
+		gst_pad_mark_reconfigure(GST_VIDEO_DECODER_SRC_PAD(decoder));
+	}
 
-		if (stream->pBuf == NULL)
+	if (!reverse_playback)
+		return FALSE;
+
+	cache_size = gst_vmeta_dec_get_reverse_cache_size(vmeta_dec);
+
+	/* The base class hands over one GOP at a time, starting with its keyframe. Whether the
+	 * GOP fits in the cache is decided based on the length of the previous GOP, since the
+	 * length of this one is not known yet. */
+	if (gst_vmeta_dec_is_keyframe(vmeta_dec, frame))
+	{
+		if (vmeta_dec->reverse_gop_length > 0)
+			vmeta_dec->reverse_last_gop_length = vmeta_dec->reverse_gop_length;
+		vmeta_dec->reverse_gop_length = 1;
+		vmeta_dec->reverse_num_cached = 1;
+
+		keyframes_only = (vmeta_dec->reverse_last_gop_length > cache_size);
+		if (keyframes_only != vmeta_dec->reverse_keyframes_only)
 		{
-			GST_ERROR_OBJECT(vmeta_dec, "reallocating stream buffer failed");
-			stream->nBufSize = 0;
-			return FALSE;
+			GST_INFO_OBJECT(
+				vmeta_dec,
+				"last GOP had %u frames, cache holds %u pictures; %s",
+				vmeta_dec->reverse_last_gop_length,
+				cache_size,
+				keyframes_only ? "decoding keyframes only" : "decoding all frames"
+			);
+			vmeta_dec->reverse_keyframes_only = keyframes_only;
 		}
+
+		return FALSE;
 	}
 
-	/* In case there is codec data, copy it over to the stream.
-	 * This is done only for the first frame; after copying, the codec_data
-	 * buffer is unref'd, and codec_data is set to NULL. */
-	if (vmeta_dec->codec_data != NULL)
+	++vmeta_dec->reverse_gop_length;
+
+	if (vmeta_dec->reverse_keyframes_only)
+		return TRUE;
+
+	/* The GOP turned out to be longer than the cache; decoding more frames would block
+	 * in the picture buffer pool, since the base class holds all pictures until the end of the GOP */
+	if (vmeta_dec->reverse_num_cached >= cache_size)
 	{
-		GstMapInfo in_map_info;
+		GST_INFO_OBJECT(vmeta_dec, "GOP does not fit in the cache (%u pictures); skipping the rest of it, decoding keyframes only", cache_size);
+		vmeta_dec->reverse_keyframes_only = TRUE;
+		return TRUE;
+	}
 
-		gst_buffer_map(vmeta_dec->codec_data, &in_map_info, GST_MAP_READ);
-		memcpy(stream->pBuf + offset, in_map_info.data, in_map_info.size);
-		gst_buffer_unmap(vmeta_dec->codec_data, &in_map_info);
+	++vmeta_dec->reverse_num_cached;
 
-		offset += codec_data_size;
+	return FALSE;
+}
 
-		gst_buffer_unref(vmeta_dec->codec_data);
-		vmeta_dec->codec_data = NULL;
-	}
 
-	/* For VC1 streams, copy over the start frame code */
-	if (add_vc1_code)
-	{
-		static guint8 const VC1FrameStartCode[4] = {0, 0, 1, 0xd};
-		stream->pBuf[offset + 0] = VC1FrameStartCode[0];
-		stream->pBuf[offset + 1] = VC1FrameStartCode[1];
-		stream->pBuf[offset + 2] = VC1FrameStartCode[2];
-		stream->pBuf[offset + 3] = VC1FrameStartCode[3];
-		offset += 4;
-	}
+static GstFlowReturn gst_vmeta_dec_resync(GstVmetaDec *vmeta_dec, GstVideoCodecFrame *current_frame)
+{
+	GstFlowReturn flow_ret;
 
-	/* Copy over the input frame data */
-	memcpy(stream->pBuf + offset, in_data, in_size);
+	/* Output what the engine still holds, and get rid of its reference pictures,
+	 * so nothing after the keyframe is predicted from corrupted pictures */
+	flow_ret = gst_vmeta_dec_recover_if_hung(vmeta_dec, gst_vmeta_dec_drain(vmeta_dec), current_frame);
 
-	stream->nDataLen = in_size_total;
-	stream->nFlag = IPP_VMETA_STRM_BUF_END_OF_UNIT; /* Necessary flag for vMeta input */
+	g_atomic_int_set(&(vmeta_dec->error_recovery), FALSE);
 
-	/* vMeta requires padded bytes to be of value 0x88
-	 * (which is the value of PADDING_BYTE) */
-	num_padding = PADDING_LEN(in_size_total);
-	if (num_padding > 0)
-		memset(stream->pBuf + in_size_total, PADDING_BYTE, num_padding);
+	/* Skipping to the keyframe because of QoS is no error recovery */
+	if (!vmeta_dec->qos_resync)
+	{
+		GST_OBJECT_LOCK(vmeta_dec);
+		++vmeta_dec->num_error_recoveries;
+		GST_OBJECT_UNLOCK(vmeta_dec);
+	}
+	vmeta_dec->qos_resync = FALSE;
 
-	return TRUE;
+	GST_INFO_OBJECT(vmeta_dec, "resynchronized at keyframe");
+
+	return flow_ret;
 }
 
 
-static gboolean gst_vmeta_dec_return_stream_buffers(GstVmetaDec *vmeta_dec)
+static GstFlowReturn gst_vmeta_dec_recover_from_hang(GstVmetaDec *vmeta_dec, GstVideoCodecFrame *current_frame)
 {
-	IppCodecStatus ret;
-	IppVmetaBitstream *stream;
+	GList *frames, *item;
+	gint64 start_time;
+	GstClockTime recovery_time;
+	guint num_hang_recoveries;
+	GstVideoDecoder *decoder = GST_VIDEO_DECODER(vmeta_dec);
 
-	while (TRUE)
+	/* Must be called with the stream lock held */
+
+	start_time = g_get_monotonic_time();
+
+	/* The decode thread is not running anymore at this point (the hang stopped it),
+	 * but it still has to be joined */
+	gst_vmeta_dec_stop_decode_thread(vmeta_dec, TRUE);
+
+	/* Stopping and freeing the decoder also gives back all streams and pictures
+	 * (see gst_vmeta_dec_reset()); nothing the hung engine holds is used again */
+	gst_vmeta_dec_free_decoder(vmeta_dec);
+
+	/* The pictures of the pending frames are lost with the engine's state. The frame
+	 * handle_frame is working on (if any) has not been decoded yet; the caller keeps it. */
+	frames = gst_video_decoder_get_frames(decoder);
+	for (item = frames; item != NULL; item = item->next)
 	{
-		ret = DecoderPopBuffer_Vmeta(IPP_VMETA_BUF_TYPE_STRM, (void **)(&stream), vmeta_dec->dec_state);
-		if (ret != IPP_STATUS_NOERR)
-		{
-			GST_ERROR_OBJECT(vmeta_dec, "failed to pop stream : %s", gst_vmeta_dec_strstatus(ret));
-			return FALSE;
-		}
+		GstVideoCodecFrame *frame = (GstVideoCodecFrame *)(item->data);
+		if (frame != current_frame)
+			gst_video_decoder_drop_frame(decoder, frame);
+		else
+			gst_video_codec_frame_unref(frame);
+	}
+	g_list_free(frames);
 
-		if (stream == NULL)
+	if (!gst_vmeta_dec_init_decoder(vmeta_dec))
+	{
+		GST_ERROR_OBJECT(vmeta_dec, "could not reinitialize the decoder after the video engine hung");
+		return GST_FLOW_ERROR;
+	}
+
+	/* The new decoder has not seen the sequence headers yet; send them again */
+	if (vmeta_dec->dec_param_set.strm_fmt == IPP_VIDEO_STRM_FMT_VC1M)
+	{
+		if (!gst_vmeta_dec_send_vc1m_seq_info(vmeta_dec, vmeta_dec->sequence_codec_data, vmeta_dec->input_state))
 		{
-			GST_LOG_OBJECT(vmeta_dec, "popped NULL stream");
-			break;
+			GST_ERROR_OBJECT(vmeta_dec, "could not resend the sequence headers after the video engine hung");
+			return GST_FLOW_ERROR;
 		}
+	}
+	else if (vmeta_dec->sequence_codec_data != NULL)
+	{
+		if (vmeta_dec->codec_data != NULL)
+			gst_buffer_unref(vmeta_dec->codec_data);
+		vmeta_dec->codec_data = gst_buffer_ref(vmeta_dec->sequence_codec_data);
+	}
 
-		GST_LOG_OBJECT(vmeta_dec, "popped stream %p", stream);
+	/* Pictures after the hang may be predicted from pictures the new decoder does not have */
+	g_atomic_int_set(&(vmeta_dec->error_recovery), TRUE);
 
-		stream->nDataLen = 0;
-		gst_vmeta_dec_push_to_list(&(vmeta_dec->streams_available), (gpointer)stream);
-	}
+	recovery_time = (GstClockTime)(g_get_monotonic_time() - start_time) * GST_USECOND;
 
-	return TRUE;
+	GST_OBJECT_LOCK(vmeta_dec);
+	num_hang_recoveries = ++vmeta_dec->num_hang_recoveries;
+	GST_OBJECT_UNLOCK(vmeta_dec);
+
+	GST_WARNING_OBJECT(
+		vmeta_dec,
+		"recovered from video engine hang:  stall: %" GST_TIME_FORMAT "  recovery: %" GST_TIME_FORMAT "  hangs so far: %u",
+		GST_TIME_ARGS(vmeta_dec->hang_stall_time),
+		GST_TIME_ARGS(recovery_time),
+		num_hang_recoveries
+	);
+
+	gst_element_post_message(
+		GST_ELEMENT(vmeta_dec),
+		gst_message_new_element(
+			GST_OBJECT(vmeta_dec),
+			gst_structure_new(
+				"vmetadec-hang-recovery",
+				"stall-time", G_TYPE_UINT64, (guint64)(vmeta_dec->hang_stall_time),
+				"recovery-time", G_TYPE_UINT64, (guint64)recovery_time,
+				"num-hang-recoveries", G_TYPE_UINT, num_hang_recoveries,
+				NULL
+			)
+		)
+	);
+
+	return GST_FLOW_OK;
 }
 
 
+static GstFlowReturn gst_vmeta_dec_recover_if_hung(GstVmetaDec *vmeta_dec, GstFlowReturn flow_ret, GstVideoCodecFrame *current_frame)
+{
+	return (flow_ret == GST_VMETA_DEC_FLOW_HANG) ? gst_vmeta_dec_recover_from_hang(vmeta_dec, current_frame) : flow_ret;
+}
 
 
-/****************************/
-/* picture buffer functions */
 
-static gboolean gst_vmeta_dec_return_picture_buffers(GstVmetaDec *vmeta_dec)
+
+/***************************/
+/* decode thread functions */
+
+static gboolean gst_vmeta_dec_start_decode_thread(GstVmetaDec *vmeta_dec)
 {
-	IppCodecStatus ret;
-	IppVmetaPicture *picture;
-	GstBuffer *picture_buffer;
+	GError *error = NULL;
 
-	while (TRUE)
-	{
-		ret = DecoderPopBuffer_Vmeta(IPP_VMETA_BUF_TYPE_PIC, (void **)(&picture), vmeta_dec->dec_state);
-		if (ret != IPP_STATUS_NOERR)
-		{
-			GST_ERROR_OBJECT(vmeta_dec, "popping picture failed : %s", gst_vmeta_dec_strstatus(ret));
-			return FALSE;
-		}
+	/* In decode thread mode, handle_frame only uploads the input data, and the decode thread
+	 * drives the video engine and finishes the frames, so upstream can work on the next frame
+	 * in the meantime. The thread takes the stream lock whenever it accesses the base class'
+	 * frames; handle_frame releases it whenever it has to wait for the thread. */
 
-		if (picture == NULL)
-		{
-			GST_LOG_OBJECT(vmeta_dec, "popped NULL picture");
-			break;
-		}
+	if (vmeta_dec->decode_thread != NULL)
+		return TRUE;
 
-		picture_buffer = gst_vmeta_dec_get_buffer_from_ipp_picture(vmeta_dec, picture);
-		if (picture_buffer != NULL)
-		{
-			GST_LOG_OBJECT(vmeta_dec, "popped picture %p (gstreamer buffer %p)", picture, picture_buffer);
-			gst_buffer_unref(picture_buffer);
-		}
-		else
-			GST_LOG_OBJECT(vmeta_dec, "popped picture %p (no gstreamer buffer)", picture);
+	vmeta_dec->decode_thread_stop = FALSE;
+	vmeta_dec->decode_thread_idle = FALSE;
+	vmeta_dec->decode_thread_flow_ret = GST_FLOW_OK;
+
+	vmeta_dec->decode_thread = g_thread_try_new("vmetadec", gst_vmeta_dec_decode_thread_func, vmeta_dec, &error);
+	if (vmeta_dec->decode_thread == NULL)
+	{
+		GST_ERROR_OBJECT(vmeta_dec, "could not start decode thread: %s", error->message);
+		g_error_free(error);
+		return FALSE;
 	}
 
 	return TRUE;
 }
 
 
-static IppVmetaPicture* gst_vmeta_dec_get_ipp_picture_from_buffer(GstVmetaDec *vmeta_decoder, GstBuffer *buffer)
+static void gst_vmeta_dec_stop_decode_thread(GstVmetaDec *vmeta_dec, gboolean stream_locked)
 {
-	GstVmetaBufferMeta *meta = GST_VMETA_BUFFER_META_GET(buffer);
-	if (meta == NULL)
-	{
-		GST_ERROR_OBJECT(vmeta_decoder, "picture buffer has no vMeta metadata");
-		return NULL;
-	}
+	if (vmeta_dec->decode_thread == NULL)
+		return;
 
-	return (IppVmetaPicture *)(meta->mvl_ipp_data);
+	GST_DEBUG_OBJECT(vmeta_dec, "stopping decode thread");
+
+	g_mutex_lock(&(vmeta_dec->streams_mutex));
+	g_atomic_int_set(&(vmeta_dec->decode_thread_stop), TRUE);
+	g_cond_broadcast(&(vmeta_dec->streams_cond));
+	g_mutex_unlock(&(vmeta_dec->streams_mutex));
+
+	/* The decode thread takes the stream lock when finishing frames;
+	 * release it while joining, otherwise the thread may never exit */
+	if (stream_locked)
+		GST_VIDEO_DECODER_STREAM_UNLOCK(vmeta_dec);
+
+	g_thread_join(vmeta_dec->decode_thread);
+
+	if (stream_locked)
+		GST_VIDEO_DECODER_STREAM_LOCK(vmeta_dec);
+
+	vmeta_dec->decode_thread = NULL;
+	vmeta_dec->decode_thread_stop = FALSE;
 }
 
 
-static GstBuffer* gst_vmeta_dec_get_buffer_from_ipp_picture(GstVmetaDec *vmeta_decoder, IppVmetaPicture *picture)
+static void gst_vmeta_dec_wait_for_decode_thread(GstVmetaDec *vmeta_dec)
 {
-	if (picture->pUsrData0 == NULL)
+	/* Must be called with the streams mutex and the stream lock held. The stream lock
+	 * is released during the wait, so that the decode thread can finish frames.
+	 * The streams mutex is unlocked before reacquiring the stream lock to preserve
+	 * the lock order (the decode thread never holds the streams mutex while taking
+	 * the stream lock). */
+	GST_VIDEO_DECODER_STREAM_UNLOCK(vmeta_dec);
+	g_cond_wait(&(vmeta_dec->streams_cond), &(vmeta_dec->streams_mutex));
+	g_mutex_unlock(&(vmeta_dec->streams_mutex));
+	GST_VIDEO_DECODER_STREAM_LOCK(vmeta_dec);
+	g_mutex_lock(&(vmeta_dec->streams_mutex));
+}
+
+
+static GstFlowReturn gst_vmeta_dec_wait_until_streams_decoded(GstVmetaDec *vmeta_dec)
+{
+	GstFlowReturn flow_ret;
+
+	/* Must be called with the stream lock held. Waits until the decode thread has
+	 * handed all ready streams to the video engine. */
+	g_mutex_lock(&(vmeta_dec->streams_mutex));
+	while ((!vmeta_dec->decode_thread_idle || (vmeta_dec->streams_ready.length != 0)) && (vmeta_dec->decode_thread_flow_ret == GST_FLOW_OK))
+		gst_vmeta_dec_wait_for_decode_thread(vmeta_dec);
+	flow_ret = vmeta_dec->decode_thread_flow_ret;
+	g_mutex_unlock(&(vmeta_dec->streams_mutex));
+
+	return flow_ret;
+}
+
+
+static gpointer gst_vmeta_dec_decode_thread_func(gpointer data)
+{
+	GstVmetaDec *vmeta_dec = GST_VMETA_DEC(data);
+	GstFlowReturn flow_ret = GST_FLOW_OK;
+
+	GST_DEBUG_OBJECT(vmeta_dec, "decode thread started");
+
+	g_mutex_lock(&(vmeta_dec->streams_mutex));
+
+	while (!vmeta_dec->decode_thread_stop)
 	{
-		GST_ERROR_OBJECT(vmeta_decoder, "IPP picture %p is not associated with a gst buffer", picture);
-		return NULL;
+		/* The video engine needs input, and none is ready -> wait for handle_frame */
+		if (vmeta_dec->upload_before_loop && (vmeta_dec->streams_ready.length == 0))
+		{
+			vmeta_dec->decode_thread_idle = TRUE;
+			g_cond_broadcast(&(vmeta_dec->streams_cond));
+			g_cond_wait(&(vmeta_dec->streams_cond), &(vmeta_dec->streams_mutex));
+			continue;
+		}
+
+		vmeta_dec->decode_thread_idle = FALSE;
+
+		g_mutex_unlock(&(vmeta_dec->streams_mutex));
+		flow_ret = gst_vmeta_dec_decode_loop(vmeta_dec);
+		g_mutex_lock(&(vmeta_dec->streams_mutex));
+
+		if (flow_ret != GST_FLOW_OK)
+			break;
 	}
 
-	return (GstBuffer *)(picture->pUsrData0);
+	if (flow_ret == GST_FLOW_OK)
+		flow_ret = GST_FLOW_FLUSHING;
+
+	vmeta_dec->decode_thread_flow_ret = flow_ret;
+	vmeta_dec->decode_thread_idle = TRUE;
+	g_cond_broadcast(&(vmeta_dec->streams_cond));
+
+	g_mutex_unlock(&(vmeta_dec->streams_mutex));
+
+	GST_DEBUG_OBJECT(vmeta_dec, "decode thread stopped: %s", gst_flow_get_name(flow_ret));
+
+	return NULL;
 }
 
 
@@ -777,48 +3683,43 @@ static GstBuffer* gst_vmeta_dec_get_buffer_from_ipp_picture(GstVmetaDec *vmeta_d
 
 static gboolean gst_vmeta_dec_start(GstVideoDecoder *decoder)
 {
-	int i;
+	guint max_streams;
 	GstVmetaDec *vmeta_dec = GST_VMETA_DEC(decoder);
 
 	GST_LOG_OBJECT(vmeta_dec, "starting decoder");
 
+	GST_OBJECT_LOCK(vmeta_dec);
+	vmeta_dec->use_decode_thread = vmeta_dec->decode_thread_enabled;
+	max_streams = vmeta_dec->max_streams;
+	vmeta_dec->scheduler_client = gst_vmeta_scheduler_client_new(GST_OBJECT(vmeta_dec), vmeta_dec->priority);
+	vmeta_dec->num_engine_waits = 0;
+	vmeta_dec->engine_wait_time = 0;
+	vmeta_dec->num_decode_calls = 0;
+	vmeta_dec->num_output_pictures = 0;
+	vmeta_dec->num_merged_uploads = 0;
+	vmeta_dec->num_hang_recoveries = 0;
+	GST_OBJECT_UNLOCK(vmeta_dec);
+
+	GST_INFO_OBJECT(vmeta_dec, "decode thread: %s  max streams: %u", vmeta_dec->use_decode_thread ? "yes" : "no", max_streams);
+
 	if (miscInitGeneralCallbackTable(&(vmeta_dec->callback_table)) != 0)
 	{
 		GST_ERROR_OBJECT(vmeta_dec, "could not initialize callback table");
 		return FALSE;
 	}
 
-	/* Preallocate streams and fill "streams" and "streams_available" GLists */
-	for (i = 0; i < NUM_STREAMS; ++i)
-	{
-		IppVmetaBitstream *stream = (IppVmetaBitstream *)g_try_malloc(sizeof(IppVmetaBitstream));
-		if (stream == NULL)
-		{
-			GST_ERROR_OBJECT(vmeta_dec, "failed to allocate stream");
-			return FALSE;
-		}
-
-		memset(stream, 0, sizeof(IppVmetaBitstream));
-		stream->pBuf = (Ipp8u *)vdec_os_api_dma_alloc_writecombine(STREAM_VDECBUF_SIZE, VMETA_STRM_BUF_ALIGN, &(stream->nPhyAddr));
-		stream->nBufSize = STREAM_VDECBUF_SIZE;
-		stream->nDataLen = 0;
-
-		if (stream->pBuf == NULL)
-		{
-			GST_ERROR_OBJECT(vmeta_dec, "allocating stream buffer failed");
-			g_free(stream);
-			stream->nBufSize = 0;
-			return FALSE;
-		}
-
-		vmeta_dec->streams = g_list_append(vmeta_dec->streams, stream);
-		vmeta_dec->streams_available = g_list_append(vmeta_dec->streams_available, stream);
-	}
+	/* Only set up the "streams" array and the queues here; the queues are sized for the
+	 * maximum number of streams, so no allocations are necessary for moving streams around.
+	 * The streams themselves are created on demand (see gst_vmeta_dec_acquire_stream()),
+	 * and their DMA buffers are sized according to the input data (see gst_vmeta_dec_copy_to_stream()),
+	 * so no DMA memory is wasted for low bitrate streams. */
+	vmeta_dec->streams = g_new0(IppVmetaBitstream *, max_streams);
+	vmeta_dec->num_streams = 0;
+	gst_vmeta_dec_stream_queue_init(&(vmeta_dec->streams_available), max_streams);
+	gst_vmeta_dec_stream_queue_init(&(vmeta_dec->streams_ready), max_streams);
 
 	/* The decoder is initialized in set_format, not here, since only then the input bitstream
-	 * format is known (and this information is necessary for initialization).
-	 * Also, streams can be allocated before the decoder is initialized, since the allocator
-	 * does not depend on it. */
+	 * format is known (and this information is necessary for initialization). */
 
 	return TRUE;
 }
@@ -830,9 +3731,45 @@ static gboolean gst_vmeta_dec_stop(GstVideoDecoder *decoder)
 
 	GST_LOG_OBJECT(vmeta_dec, "stopping decoder");
 
+	/* The decode thread uses the decoder and the streams, so stop it first */
+	gst_vmeta_dec_stop_decode_thread(vmeta_dec, FALSE);
+
 	/* First free the decoder, BEFORE freeing the DMA buffers */
 	gst_vmeta_dec_free_decoder(vmeta_dec);
 
+	if (vmeta_dec->scheduler_client != NULL)
+	{
+		GstVmetaSchedulerStats stats;
+		gst_vmeta_scheduler_client_get_stats(vmeta_dec->scheduler_client, &stats);
+		GST_INFO_OBJECT(
+			vmeta_dec,
+			"engine usage:  occupancy: %.1f%%  slices: %" G_GUINT64_FORMAT "  busy: %" GST_TIME_FORMAT "  waiting: %" GST_TIME_FORMAT "  elapsed: %" GST_TIME_FORMAT,
+			stats.occupancy * 100.0,
+			stats.num_slices,
+			GST_TIME_ARGS(stats.busy_time),
+			GST_TIME_ARGS(stats.wait_time),
+			GST_TIME_ARGS(stats.elapsed_time)
+		);
+		GST_INFO_OBJECT(
+			vmeta_dec,
+			"engine waits: %" G_GUINT64_FORMAT "  time spent waiting: %" GST_TIME_FORMAT,
+			vmeta_dec->num_engine_waits,
+			GST_TIME_ARGS(vmeta_dec->engine_wait_time)
+		);
+		GST_INFO_OBJECT(
+			vmeta_dec,
+			"DecodeFrame_Vmeta() calls: %" G_GUINT64_FORMAT "  output pictures: %" G_GUINT64_FORMAT "  merged uploads: %u",
+			vmeta_dec->num_decode_calls,
+			vmeta_dec->num_output_pictures,
+			vmeta_dec->num_merged_uploads
+		);
+
+		GST_OBJECT_LOCK(vmeta_dec);
+		gst_vmeta_scheduler_client_free(vmeta_dec->scheduler_client);
+		vmeta_dec->scheduler_client = NULL;
+		GST_OBJECT_UNLOCK(vmeta_dec);
+	}
+
 	if (vmeta_dec->callback_table != NULL)
 	{
 		miscFreeGeneralCallbackTable(&(vmeta_dec->callback_table));
@@ -841,29 +3778,41 @@ static gboolean gst_vmeta_dec_stop(GstVideoDecoder *decoder)
 
 	/* Free the stream DMA buffers */
 	{
-		GList *elem;
+		guint i;
 
-		for (elem = vmeta_dec->streams; elem != NULL; elem = elem->next)
+		for (i = 0; i < vmeta_dec->num_streams; ++i)
 		{
-			IppVmetaBitstream *stream = (IppVmetaBitstream *)(elem->data);
+			IppVmetaBitstream *stream = vmeta_dec->streams[i];
+			gst_vmeta_dec_clear_stream(stream);
 			if (stream->pBuf != NULL)
 				vdec_os_api_dma_free(stream->pBuf);
 			g_free(stream);
 		}
 
-		g_list_free(vmeta_dec->streams);
-		g_list_free(vmeta_dec->streams_available);
-		g_list_free(vmeta_dec->streams_ready);
+		g_free(vmeta_dec->streams);
+		gst_vmeta_dec_stream_queue_free(&(vmeta_dec->streams_available));
+		gst_vmeta_dec_stream_queue_free(&(vmeta_dec->streams_ready));
 
 		vmeta_dec->streams = NULL;
-		vmeta_dec->streams_available = NULL;
-		vmeta_dec->streams_ready = NULL;
+		vmeta_dec->num_streams = 0;
+	}
+
+	if (vmeta_dec->codec_data != NULL)
+	{
+		gst_buffer_unref(vmeta_dec->codec_data);
+		vmeta_dec->codec_data = NULL;
+	}
+
+	if (vmeta_dec->sequence_codec_data != NULL)
+	{
+		gst_buffer_unref(vmeta_dec->sequence_codec_data);
+		vmeta_dec->sequence_codec_data = NULL;
 	}
 
-	if (vmeta_dec->codec_data != NULL)
+	if (vmeta_dec->input_state != NULL)
 	{
-		gst_buffer_unref(vmeta_dec->codec_data);
-		vmeta_dec->codec_data = NULL;
+		gst_video_codec_state_unref(vmeta_dec->input_state);
+		vmeta_dec->input_state = NULL;
 	}
 
 	return TRUE;
@@ -872,382 +3821,306 @@ static gboolean gst_vmeta_dec_stop(GstVideoDecoder *decoder)
 
 static gboolean gst_vmeta_dec_set_format(GstVideoDecoder *decoder, GstVideoCodecState *state)
 {
-	IppCodecStatus ret;
-	GstBuffer *codec_data = NULL;
+	IppVmetaDecParSet old_param_set;
+	gboolean reuse_decoder;
+	GstBuffer *codec_data = NULL, *avc_codec_data = NULL;
 	GstVmetaDec *vmeta_dec = GST_VMETA_DEC(decoder);
 
 	GST_LOG_OBJECT(vmeta_dec, "setting new format");
 
-	if (vmeta_dec->dec_state != NULL)
-		gst_vmeta_dec_free_decoder(vmeta_dec);
+	/* The set_format call comes with the stream lock held */
+	gst_vmeta_dec_stop_decode_thread(vmeta_dec, TRUE);
 
-	memset(&(vmeta_dec->dec_info), 0, sizeof(IppVmetaDecInfo));
+	/* Keep the current parameters around to find out if the decoder can be reused */
+	old_param_set = vmeta_dec->dec_param_set;
 
 	/* codec_data does not need to be unref'd after use; it is owned by the caps structure */
 	if (!gst_vmeta_dec_fill_param_set(vmeta_dec, state, &codec_data))
 	{
 		GST_ERROR_OBJECT(vmeta_dec, "could not fill open params: state info incompatible");
+		gst_vmeta_dec_free_decoder(vmeta_dec);
 		return FALSE;
 	}
 
-	/* The actual initialization; requires bitstream information (such as the codec type), which
-	 * is determined by the fill_param_set call before */
-	ret = DecoderInitAlloc_Vmeta(&(vmeta_dec->dec_param_set), vmeta_dec->callback_table, &(vmeta_dec->dec_state));
-	if (ret != IPP_STATUS_NOERR)
+	gst_vmeta_bitstream_parser_init(&(vmeta_dec->bitstream_parser), vmeta_dec->dec_param_set.strm_fmt);
+	if (codec_data != NULL)
 	{
-		GST_ERROR_OBJECT(vmeta_dec, "failed to initialize&alloc vMeta state : %s", gst_vmeta_dec_strstatus(ret));
-		return FALSE;
-	}
+		GstMapInfo codec_data_map;
+		gst_buffer_map(codec_data, &codec_data_map, GST_MAP_READ);
+		gst_vmeta_bitstream_parser_parse_codec_data(&(vmeta_dec->bitstream_parser), codec_data_map.data, codec_data_map.size);
 
-	gst_video_decoder_set_output_state(decoder, GST_VIDEO_FORMAT_UYVY, state->info.width, state->info.height, state);
+		/* h.264 codec_data is only used with avc streams. The video engine only accepts
+		 * byte-stream data, so the SPS and PPS are converted, and then sent in-band like the
+		 * codec_data of the other formats. The length prefixes of the NAL units in the frames
+		 * are replaced during the upload (see gst_vmeta_dec_copy_to_stream()). */
+		if (vmeta_dec->dec_param_set.strm_fmt == IPP_VIDEO_STRM_FMT_H264)
+		{
+			gsize sps_pps_size;
+			guint8 *sps_pps = gst_vmeta_bitstream_h264_avcc_to_byte_stream(codec_data_map.data, codec_data_map.size, &sps_pps_size);
+			if (sps_pps != NULL)
+				avc_codec_data = gst_buffer_new_wrapped(sps_pps, sps_pps_size);
+		}
 
-	/* For WMV3, a special header has to be sent to the decoder first
-	 * The codec_data buffer is consumed during this process */
-	if (vmeta_dec->dec_param_set.strm_fmt == IPP_VIDEO_STRM_FMT_VC1M)
-	{
-		GstMapInfo codec_data_map;
-		unsigned char* cdata;
-		unsigned int csize;
+		gst_buffer_unmap(codec_data, &codec_data_map);
 
-		if (codec_data == NULL)
+		if ((vmeta_dec->dec_param_set.strm_fmt == IPP_VIDEO_STRM_FMT_H264) && (avc_codec_data == NULL))
 		{
-			GST_ERROR_OBJECT(vmeta_dec, "WMV3/VC1-SPMP data without codec_data");
+			GST_ERROR_OBJECT(vmeta_dec, "invalid avcC codec_data");
+			gst_vmeta_dec_free_decoder(vmeta_dec);
 			return FALSE;
 		}
+	}
+	vmeta_dec->qos_keyframes_only = FALSE;
+
+	/* NAL-aligned and unparsed input is collected into access units in the parse function */
+	gst_video_decoder_set_packetized(decoder, !(vmeta_dec->nal_alignment || vmeta_dec->unparsed_input));
+	vmeta_dec->au_has_picture = FALSE;
+
+	/* Keep the state and a copy of the codec_data around, to be able to reinitialize
+	 * the decoder and resend the sequence headers after the video engine hung */
+	if (vmeta_dec->input_state != NULL)
+		gst_video_codec_state_unref(vmeta_dec->input_state);
+	vmeta_dec->input_state = gst_video_codec_state_ref(state);
+	if (vmeta_dec->sequence_codec_data != NULL)
+		gst_buffer_unref(vmeta_dec->sequence_codec_data);
+	if (avc_codec_data != NULL)
+		vmeta_dec->sequence_codec_data = avc_codec_data;
+	else
+		vmeta_dec->sequence_codec_data = (codec_data != NULL) ? gst_buffer_copy(codec_data) : NULL;
+
+	gst_vmeta_dec_init_stream_size(vmeta_dec, state);
+	gst_vmeta_dec_estimate_dpb_size(vmeta_dec, state);
+	gst_vmeta_dec_configure_reordering(vmeta_dec, state);
+
+	/* If only things like the framerate, the pixel aspect ratio, or the codec_data changed,
+	 * keep the decoder, its streams, and its pictures; new codec_data is sent in-band,
+	 * prepended to the next frame, and the video engine picks up the new sequence headers
+	 * from there. This avoids a stall at every caps change (for example, in playlists or
+	 * with adaptive streaming). */
+	if ((vmeta_dec->dec_state != NULL) && gst_vmeta_dec_can_reuse_decoder(vmeta_dec, &old_param_set, state))
+	{
+		GST_INFO_OBJECT(vmeta_dec, "new format is compatible with the current one; reusing decoder");
+		reuse_decoder = TRUE;
+	}
+	else
+	{
+		reuse_decoder = FALSE;
 
-		gst_buffer_map(codec_data, &codec_data_map, GST_MAP_READ);
-		cdata = codec_data_map.data;
-		csize = codec_data_map.size;
-
-		vc1m_seq_header seq_header;
-		seq_header.num_frames = 0xffffff;
-		seq_header.vert_size = state->info.height;
-		seq_header.horiz_size = state->info.width;
-		seq_header.level = ((cdata[0] >> 4) == 4) ? 4 : 2;
-		seq_header.cbr = 1;
-		seq_header.hrd_buffer = 0x007fff;
-		seq_header.hrd_rate = 0x00007fff;
-		seq_header.frame_rate = 0xffffffff;
-		memcpy(seq_header.exthdr, cdata, csize);
-		seq_header.exthdrsize = csize;
-		ret = DecodeSendCmd_Vmeta(IPPVC_SET_VC1M_SEQ_INFO, &seq_header, NULL, vmeta_dec->dec_state);
+		if (vmeta_dec->dec_state != NULL)
+			gst_vmeta_dec_free_decoder(vmeta_dec);
 
-		gst_buffer_unmap(codec_data, &codec_data_map);
+		if (!gst_vmeta_dec_init_decoder(vmeta_dec))
+			return FALSE;
+	}
 
-		/* codec_data buffer was used already ; make sure it is not sent again */
-		codec_data = NULL;
+	gst_video_codec_state_unref(gst_vmeta_dec_set_output_state(vmeta_dec, state->info.width, state->info.height, state));
+	gst_vmeta_dec_update_latency(vmeta_dec, state);
 
-		if (ret != IPP_STATUS_NOERR)
-		{
-			GST_ERROR_OBJECT(vmeta_dec, "failed to send WMV3/VC1-SPMP seq info to decoder: %s", gst_vmeta_dec_strstatus(ret));
+	/* For WMV3, a special header has to be sent to the decoder first
+	 * The codec_data buffer is consumed during this process */
+	if (!reuse_decoder && (vmeta_dec->dec_param_set.strm_fmt == IPP_VIDEO_STRM_FMT_VC1M))
+	{
+		if (!gst_vmeta_dec_send_vc1m_seq_info(vmeta_dec, codec_data, state))
 			return FALSE;
-		}
+
+		/* codec_data buffer was used already ; make sure it is not sent again */
+		codec_data = NULL;
 	}
 
-	/* Copy the buffer, to make sure the codec_data lifetime does not depend on the caps */
+	/* Copy the buffer, to make sure the codec_data lifetime does not depend on the caps;
+	 * if previous codec_data was not sent yet, it is superseded by the new one */
 	if (codec_data != NULL)
-		vmeta_dec->codec_data = gst_buffer_copy(codec_data);
+	{
+		if (vmeta_dec->codec_data != NULL)
+			gst_buffer_unref(vmeta_dec->codec_data);
+		vmeta_dec->codec_data = gst_buffer_ref(vmeta_dec->sequence_codec_data);
+	}
 
 	return TRUE;
 }
 
 
-static GstFlowReturn gst_vmeta_dec_handle_frame(GstVideoDecoder *decoder, GstVideoCodecFrame *frame)
+static GstFlowReturn gst_vmeta_dec_parse(GstVideoDecoder *decoder, GstVideoCodecFrame *frame, GstAdapter *adapter, gboolean at_eos)
 {
-	IppCodecStatus ret;
-	IppVmetaBitstream *stream;
-	IppVmetaPicture *picture;
-	gboolean decode_only, do_finish, run_decoding_loop, input_already_delivered, do_eos, picture_decoded;
 	GstVmetaDec *vmeta_dec = GST_VMETA_DEC(decoder);
 
+	/* Only used with NAL-aligned h.264 input and with unparsed input; the decoder is packetized otherwise */
+	if (vmeta_dec->unparsed_input)
+		return gst_vmeta_dec_assemble_au(vmeta_dec, frame, adapter, at_eos);
+	else
+		return gst_vmeta_dec_collect_nal_units(vmeta_dec, frame, adapter, at_eos);
+}
 
-	/* The code in here orients itself towards the IPP_STATUS_NEED_INPUT status codes.
-	 * The first time IPP_STATUS_NEED_INPUT is returned by DecodeFrame_Vmeta(), the input data
-	 * from the frame parameter is pushed to the video engine. Then, the loop continues.
-	 * During the loops, the decoder may request pictures, and return completed pictures.
-	 * If more than one completed picture is returned for the input data, all but the first
-	 * are dropped (this is a current GStreamer limitation; see below). The looping continues
-	 * until either EOS or an error is reported, or IPP_STATUS_NEED_INPUT is returned again.
-	 * Looping stops then.
-	 *
-	 * The idea behind this is that the handle_frame function is "input-oriented", that is,
-	 * every time it is called, it means there is a new input frame to decode. So the code inside
-	 * here does as much as possible with the input data until the video engine is done with it
-	 * and requires new input data.
-	 *
-	 * The upload_before_loop boolean is tied to this. Initially, it is set to FALSE.
-	 * The very first time handle_frame is called, DecodeFrame_Vmeta() has not been called yet.
-	 * Then, in the first loop, DecodeFrame_Vmeta() is called, IPP_STATUS_NEED_INPUT is returned the
-	 * first time. The input data is pushed to the video engine, the loop does all it can, until the
-	 * second IPP_STATUS_NEED_INPUT status code is returned. upload_before_loop is set to TRUE,
-	 * the loop exits, and so does the handle_frame function.
-	 * The next time handle_frame is called, upload_before_loop is TRUE, and the loop immediately
-	 * pushes the input data to the video engine, effectively omitting the first IPP_STATUS_NEED_INPUT
-	 * status code. This means upload_before_loop is FALSE only before the first handle_frame, and TRUE
-	 * afterwards. This mechanism prevents unnecessary DecodeFrame_Vmeta() calls.
-	 */
 
+static GstFlowReturn gst_vmeta_dec_handle_frame(GstVideoDecoder *decoder, GstVideoCodecFrame *frame)
+{
+	GstFlowReturn flow_ret = GST_FLOW_OK;
+	gboolean key_units_only;
+	GstVmetaDec *vmeta_dec = GST_VMETA_DEC(decoder);
 
-	/* Convenience macros */
-#define PUSH_AVAILABLE_STREAM()   gst_vmeta_dec_push_to_list(&(vmeta_dec->streams_available),  (gpointer)stream)
-#define PUSH_READY_STREAM()       gst_vmeta_dec_push_to_list(&(vmeta_dec->streams_ready),      (gpointer)stream)
-
-#define POP_AVAILABLE_STREAM() \
-	do { \
-		stream = gst_vmeta_dec_pop_from_list(&(vmeta_dec->streams_available)); \
-		if (stream == NULL) \
-		{ \
-			GST_ERROR_OBJECT(vmeta_dec, "no streams available"); \
-			return GST_FLOW_ERROR; \
-		} \
-	} while (0)
-
-#define POP_READY_STREAM() \
-	do { \
-		stream = gst_vmeta_dec_pop_from_list(&(vmeta_dec->streams_ready)); \
-		if (stream == NULL) \
-		{ \
-			GST_ERROR_OBJECT(vmeta_dec, "no streams ready"); \
-			return GST_FLOW_ERROR; \
-		} \
-	} while (0)
-
-
-	/* Prepare a stream containing the input data (if there is input data) */
-	if (frame->input_buffer != NULL)
+	/* The decode thread may have stopped because of an error, because downstream is flushing,
+	 * or because the video engine hung; recover from a hang, and report anything else upstream */
+	if (vmeta_dec->decode_thread != NULL)
 	{
-		gboolean copy_ok;
-		GstMapInfo in_map_info;
-
-		POP_AVAILABLE_STREAM();
-		gst_buffer_map(frame->input_buffer, &in_map_info, GST_MAP_READ);
-		copy_ok = gst_vmeta_dec_copy_to_stream(vmeta_dec, stream, in_map_info.data, in_map_info.size);
-		gst_buffer_unmap(frame->input_buffer, &in_map_info);
+		g_mutex_lock(&(vmeta_dec->streams_mutex));
+		flow_ret = vmeta_dec->decode_thread_flow_ret;
+		g_mutex_unlock(&(vmeta_dec->streams_mutex));
 
-		if (copy_ok)
-			PUSH_READY_STREAM();
-		else
+		flow_ret = gst_vmeta_dec_recover_if_hung(vmeta_dec, flow_ret, frame);
+		if (flow_ret != GST_FLOW_OK)
 		{
-			stream->nDataLen = 0;
-			PUSH_AVAILABLE_STREAM();
-			GST_ERROR_OBJECT(vmeta_dec, "failed to upload input data to stream buffer");
-			return GST_FLOW_ERROR;
+			GST_DEBUG_OBJECT(vmeta_dec, "decode thread reported %s", gst_flow_get_name(flow_ret));
+			gst_video_codec_frame_unref(frame);
+			return flow_ret;
 		}
 	}
 
-	GST_LOG_OBJECT(vmeta_dec, "upload before running decode loop: %s", vmeta_dec->upload_before_loop ? "yes" : "no");
-
-	if (vmeta_dec->upload_before_loop)
+	/* After a decoding error, discard frames until the next keyframe. This is done before
+	 * the decode thread is (re)started, since resynchronizing stops it. */
+	if ((frame->input_buffer != NULL) && g_atomic_int_get(&(vmeta_dec->error_recovery)))
 	{
-		/* video engine requires more input, but nothing is coming anymore -> signal EOS */
-		if (frame->input_buffer == NULL)
+		if (!gst_vmeta_dec_is_keyframe(vmeta_dec, frame))
 		{
-			GST_INFO_OBJECT(vmeta_dec, "NULL input buffer received -> signaling EOS");
-			return GST_FLOW_EOS;
+			GST_DEBUG_OBJECT(vmeta_dec, "error recovery: discarding frame %u", frame->system_frame_number);
+
+			/* Frames discarded after a bitstream error are not late, so they are not dropped
+			 * (which would post QoS messages); frames skipped because of QoS are late */
+			if (vmeta_dec->qos_resync)
+				return gst_video_decoder_drop_frame(decoder, frame);
+
+			GST_VIDEO_CODEC_FRAME_SET_DECODE_ONLY(frame);
+			return gst_video_decoder_finish_frame(decoder, frame);
 		}
 
-		POP_READY_STREAM();
-		ret = DecoderPushBuffer_Vmeta(IPP_VMETA_BUF_TYPE_STRM, stream, vmeta_dec->dec_state);
-		if (ret != IPP_STATUS_NOERR)
+		flow_ret = gst_vmeta_dec_resync(vmeta_dec, frame);
+		if (flow_ret != GST_FLOW_OK)
 		{
-			stream->nDataLen = 0;
-			PUSH_AVAILABLE_STREAM();
-			GST_ERROR_OBJECT(vmeta_dec, "failed to push stream buffer : %s", gst_vmeta_dec_strstatus(ret));
-			return GST_FLOW_ERROR;
+			gst_video_codec_frame_unref(frame);
+			return flow_ret;
 		}
-
-		vmeta_dec->upload_before_loop = FALSE;
-		input_already_delivered = TRUE;
 	}
-	else
-		input_already_delivered = FALSE;
 
-	decode_only = TRUE;
-	do_finish = FALSE;
-	run_decoding_loop = TRUE;
-	do_eos = FALSE;
-	picture_decoded = FALSE;
-
-	while (run_decoding_loop)
+	/* In key unit trick modes, the engine is drained after every keyframe, which stops the
+	 * decode thread; rather than starting and joining a thread for every picture, decode
+	 * synchronously, and stop a thread which is still running from normal playback */
+	key_units_only = (decoder->input_segment.flags & GST_SEGMENT_FLAG_TRICKMODE_KEY_UNITS) != 0;
+	if (key_units_only && (vmeta_dec->decode_thread != NULL))
 	{
-		ret = DecodeFrame_Vmeta(&(vmeta_dec->dec_info), vmeta_dec->dec_state);
-		GST_LOG_OBJECT(vmeta_dec, "DecodeFrame_Vmeta() returned code %d (%s)", (gint)(ret), gst_vmeta_dec_strstatus(ret));
-		switch (ret)
+		flow_ret = gst_vmeta_dec_recover_if_hung(vmeta_dec, gst_vmeta_dec_drain(vmeta_dec), frame);
+		if (flow_ret != GST_FLOW_OK)
 		{
-			/* TODO:
-			 * there are two status codes, IPP_STATUS_END_OF_PICTURE and
-			 * IPP_STATUS_END_OF_STREAM , which never ever are returned by the
-			 * DecodeFrame_Vmeta() function. What are these? */
-
-			case IPP_STATUS_NEED_INPUT:
-			{
-				if (input_already_delivered)
-				{
-					/* the input has already been delivered
-					 * -> exit, and wait until handle_frame() is called again, with
-					 * new input; the block before the main loop then uploads the input */
-					vmeta_dec->upload_before_loop = TRUE;
-					run_decoding_loop = FALSE;
-				}
-				else
-				{
-					/* video engine requires more input, but nothing is coming anymore -> signal EOS */
-					if (frame->input_buffer == NULL)
-					{
-						GST_INFO_OBJECT(vmeta_dec, "NULL input buffer received -> signaling EOS");
-						return GST_FLOW_EOS;
-					}
-
-					POP_READY_STREAM();
-					ret = DecoderPushBuffer_Vmeta(IPP_VMETA_BUF_TYPE_STRM, stream, vmeta_dec->dec_state);
-					if (ret != IPP_STATUS_NOERR)
-					{
-						stream->nDataLen = 0;
-						PUSH_AVAILABLE_STREAM();
-						GST_ERROR_OBJECT(vmeta_dec, "failed to push stream buffer : %s", gst_vmeta_dec_strstatus(ret));
-						return GST_FLOW_ERROR;
-					}
-
-					input_already_delivered = TRUE;
-				}
-				break;
-			}
-			case IPP_STATUS_RETURN_INPUT_BUF:
-			{
-				if (!gst_vmeta_dec_return_stream_buffers(vmeta_dec))
-					return GST_FLOW_ERROR;
-				break;
-			}
-			case IPP_STATUS_FRAME_COMPLETE:
-			{
-				ret = DecoderPopBuffer_Vmeta(IPP_VMETA_BUF_TYPE_PIC, (void **)(&picture), vmeta_dec->dec_state);
-				if (ret != IPP_STATUS_NOERR)
-				{
-					GST_ERROR_OBJECT(vmeta_dec, "failed to pop picture : %s", gst_vmeta_dec_strstatus(ret));
-					return GST_FLOW_ERROR;
-				}
+			gst_video_codec_frame_unref(frame);
+			return flow_ret;
+		}
+	}
 
-				/* DecoderPopBuffer_Vmeta() sometimes returns NULL after a completed frame.
-				 * When this happens, this NULL frame has to be ignored. Return stream buffers
-				 * and suspend-resume as usual, but that's it. The next frame returns non-NULL. */
-				if (picture != NULL)
-				{
-					GstBuffer *picture_buffer;
+	if (vmeta_dec->use_decode_thread && !key_units_only && !gst_vmeta_dec_start_decode_thread(vmeta_dec))
+	{
+		gst_video_codec_frame_unref(frame);
+		return GST_FLOW_ERROR;
+	}
 
-					GST_LOG_OBJECT(vmeta_dec, "pic type: %u coded type: %d %d poc: %d %d offset: %u datalen: %u bufsize: %u", picture->PicDataInfo.pic_type, picture->PicDataInfo.coded_type[0], picture->PicDataInfo.coded_type[1], picture->PicDataInfo.poc[0], picture->PicDataInfo.poc[1], picture->nOffset, picture->nDataLen, picture->nBufSize);
+	/* During reverse playback, skip the frames which do not fit in the picture cache */
+	if ((frame->input_buffer != NULL) && gst_vmeta_dec_reverse_skip_frame(vmeta_dec, frame))
+	{
+		GST_LOG_OBJECT(vmeta_dec, "reverse playback: skipping frame %u", frame->system_frame_number);
+		GST_VIDEO_CODEC_FRAME_SET_DECODE_ONLY(frame);
+		return gst_video_decoder_finish_frame(decoder, frame);
+	}
 
-					picture_buffer = gst_vmeta_dec_get_buffer_from_ipp_picture(vmeta_dec, picture);
-					if (picture_buffer == NULL)
-					{
-						GST_ERROR_OBJECT(vmeta_dec, "IPP picture %p is not associated with a gstreamer buffer", picture);
-						return GST_FLOW_ERROR;
-					}
+	/* In key unit trick modes, skip everything but keyframes without touching the video engine;
+	 * skipped frames are not late, so they are not dropped (which would post QoS messages) */
+	if ((frame->input_buffer != NULL) && key_units_only && !gst_vmeta_dec_is_keyframe(vmeta_dec, frame))
+	{
+		GST_LOG_OBJECT(vmeta_dec, "key unit trick mode: skipping frame %u", frame->system_frame_number);
+		GST_VIDEO_CODEC_FRAME_SET_DECODE_ONLY(frame);
+		return gst_video_decoder_finish_frame(decoder, frame);
+	}
 
-					GST_LOG_OBJECT(vmeta_dec, "popped picture %p (gstreamer buffer %p)", picture, picture_buffer);
+	/* Skip frames the pipeline is too late for, without uploading them */
+	if ((frame->input_buffer != NULL) && gst_vmeta_dec_qos_drop_frame(vmeta_dec, frame))
+		return gst_video_decoder_drop_frame(decoder, frame);
 
-					if (picture_decoded)
-					{
-						/*
-						 * TODO: this is temporary
-						 * currently, GStreamer cannot handle cases where one stream
-						 * causes the decoder to produce more than one picture
-						 * (the GstVideoDecoder base class would need a possibility to send
-						 * more than one frame downstream)
-						 * so far, this has only happened with h.264 MVC data; since GStreamer
-						 * is currently also lacking proper MVC support, it is pointless to worry
-						 * about how to send multiple output pictures downstream
-						 * -> dropping extra pictures for now by returning them to the available
-						 * picture list */
-						GST_DEBUG_OBJECT(vmeta_dec, "more than one picture decoded for one stream - dropping additional picture to maintain 1:1 ratio");
-						gst_buffer_unref(picture_buffer);
-					}
-					else
-					{
-						frame->output_buffer = picture_buffer;
-						decode_only = FALSE;
-						do_finish = TRUE;
-						picture_decoded = TRUE;
-					}
-				}
-				else
-					GST_LOG_OBJECT(vmeta_dec, "popped NULL picture");
+	/* Prepare a stream containing the input data (if there is input data);
+	 * the stream is appended to the "streams_ready" queue */
+	if (frame->input_buffer != NULL)
+		flow_ret = gst_vmeta_dec_upload_frame(vmeta_dec, frame);
 
-				if (!gst_vmeta_dec_return_stream_buffers(vmeta_dec))
-					return GST_FLOW_ERROR;
+	/* The frame stays in the base class' list of pending frames until a picture is
+	 * decoded for it (see gst_vmeta_dec_output_picture()) */
+	gst_video_codec_frame_unref(frame);
 
-				if (!gst_vmeta_dec_suspend_and_resume(vmeta_dec))
-					return GST_FLOW_ERROR;
+	if (flow_ret != GST_FLOW_OK)
+		return gst_vmeta_dec_recover_if_hung(vmeta_dec, flow_ret, NULL);
 
-				break;
-			}
-			case IPP_STATUS_NEED_OUTPUT_BUF:
-			{
-				GstBuffer *picture_buffer = gst_video_decoder_allocate_output_buffer(decoder);
-				picture = gst_vmeta_dec_get_ipp_picture_from_buffer(vmeta_dec, picture_buffer);
+	GST_LOG_OBJECT(vmeta_dec, "upload before running decode loop: %s", vmeta_dec->upload_before_loop ? "yes" : "no");
 
-				g_assert(picture != NULL);
+	/* In decode thread mode, the thread has been woken up by the upload,
+	 * and decodes the stream; otherwise, decode it right here */
+	if (vmeta_dec->decode_thread == NULL)
+		flow_ret = gst_vmeta_dec_decode_loop(vmeta_dec);
 
-				GST_LOG_OBJECT(vmeta_dec, "pushing picture: %p", picture);
+	/* In key unit trick modes, the next keyframe may be far away; get the
+	 * keyframe's picture out now, and start the next keyframe from scratch */
+	if ((flow_ret == GST_FLOW_OK) && key_units_only)
+		flow_ret = gst_vmeta_dec_drain(vmeta_dec);
 
-				ret = DecoderPushBuffer_Vmeta(IPP_VMETA_BUF_TYPE_PIC, picture, vmeta_dec->dec_state);
-				if (ret != IPP_STATUS_NOERR)
-				{
-					GST_ERROR_OBJECT(vmeta_dec, "pushing picture failed : %s", gst_vmeta_dec_strstatus(ret));
-					gst_buffer_unref(picture_buffer);
- 					return GST_FLOW_ERROR;
-				}
+	/* The frame is lost if the engine hung while decoding it; decoding resumes at the next keyframe */
+	return gst_vmeta_dec_recover_if_hung(vmeta_dec, flow_ret, NULL);
+}
 
-				break;
-			}
-			case IPP_STATUS_NEW_VIDEO_SEQ:
-			{
-				/* When a new sequence is started, pull all pictures from the video
-				 * engine; completed ones have already been processed before anyway */
-				if (!gst_vmeta_dec_return_picture_buffers(vmeta_dec))
-					return GST_FLOW_ERROR;
-				break;
-			}
-			case IPP_STATUS_END_OF_STREAM:
-			{
-				GST_DEBUG_OBJECT(vmeta_dec, "end of stream reached");
 
-				/* TODO: There is a VC1 start code for end-of-sequence.
-				 * It is unclear if this has to be sent to vMeta, or if it is optional,
-				 * or if the data already contains it.
-				 * The marvell plugins for GStreamer 0.10 seem to send it under some
-				 * conditions. Omitting it here for now (decoder shutdown works fine
-				 * without it). */
+static GstFlowReturn gst_vmeta_dec_finish(GstVideoDecoder *decoder)
+{
+	GstFlowReturn flow_ret;
+	GstVmetaDec *vmeta_dec = GST_VMETA_DEC(decoder);
 
-				do_eos = TRUE;
-				run_decoding_loop = FALSE;
-				break;
-			}
-			case IPP_STATUS_WAIT_FOR_EVENT:
-				break;
-			default:
-			{
-				GST_DEBUG_OBJECT(vmeta_dec, "DecodeFrame_Vmeta() returned unhandled code %d (%s)", (gint)(ret), gst_vmeta_dec_strstatus(ret));
-			}
-		}
+	/* With NAL-aligned and unparsed input, an access unit is only complete once the next one begins;
+	 * since no more data follows, the last one is decoded now */
+	if (vmeta_dec->au_has_picture)
+	{
+		vmeta_dec->au_has_picture = FALSE;
+		flow_ret = gst_video_decoder_have_frame(decoder);
+		if (flow_ret != GST_FLOW_OK)
+			return flow_ret;
 	}
 
-	if (do_finish)
-	{
-		if (decode_only)
-			GST_VIDEO_CODEC_FRAME_SET_DECODE_ONLY(frame);
+	/* During reverse playback, finish is called at the end of each GOP; all of
+	 * its pictures have to be output before the base class reverses them */
+	if (vmeta_dec->reverse_playback)
+		return gst_vmeta_dec_recover_if_hung(vmeta_dec, gst_vmeta_dec_drain(vmeta_dec), NULL);
 
-		gst_video_decoder_finish_frame(decoder, frame);
+	if (vmeta_dec->decode_thread != NULL)
+	{
+		flow_ret = gst_vmeta_dec_recover_if_hung(vmeta_dec, gst_vmeta_dec_wait_until_streams_decoded(vmeta_dec), NULL);
+		if (flow_ret != GST_FLOW_OK)
+			return flow_ret;
 	}
 
-	return do_eos ? GST_FLOW_EOS : GST_FLOW_OK;
+	/* No frame follows which could take a held picture */
+	return gst_vmeta_dec_push_held_picture(vmeta_dec);
 }
 
 
 static gboolean gst_vmeta_dec_reset(GstVideoDecoder *decoder, G_GNUC_UNUSED gboolean hard)
 {
 	gboolean ret = TRUE;
+	IppVmetaBitstream *stream;
 	GstVmetaDec *vmeta_dec = GST_VMETA_DEC(decoder);
 
+	/* The reset call comes with the stream lock held */
+	gst_vmeta_dec_stop_decode_thread(vmeta_dec, TRUE);
+
+	/* The base class discards partially collected access units */
+	vmeta_dec->au_has_picture = FALSE;
+
+	/* A held picture belongs to the data before the flush */
+	if (vmeta_dec->held_picture != NULL)
+	{
+		gst_buffer_unref(vmeta_dec->held_picture);
+		vmeta_dec->held_picture = NULL;
+	}
+
 	if (vmeta_dec->dec_state == NULL)
 	{
 		GST_LOG_OBJECT(vmeta_dec, "decoder not initialized yet - ignoring reset call");
@@ -1257,15 +4130,31 @@ static gboolean gst_vmeta_dec_reset(GstVideoDecoder *decoder, G_GNUC_UNUSED gboo
 	ret = gst_vmeta_dec_return_stream_buffers(vmeta_dec) && ret;
 	ret = gst_vmeta_dec_return_picture_buffers(vmeta_dec) && ret;
 
+	/* Streams which were filled but not yet pushed to the video engine are discarded */
+	g_mutex_lock(&(vmeta_dec->streams_mutex));
+	while ((stream = gst_vmeta_dec_stream_queue_pop(&(vmeta_dec->streams_ready))) != NULL)
+	{
+		gst_vmeta_dec_clear_stream(stream);
+		gst_vmeta_dec_stream_queue_push(&(vmeta_dec->streams_available), stream);
+	}
+
 	GST_DEBUG_OBJECT(
 		vmeta_dec,
 		"after reset:  available streams: %u",
-		g_list_length(vmeta_dec->streams_available)
+		vmeta_dec->streams_available.length
 	);
 
-	g_list_free(vmeta_dec->streams_ready);
+	g_mutex_unlock(&(vmeta_dec->streams_mutex));
 
 	vmeta_dec->upload_before_loop = FALSE;
+	vmeta_dec->num_expected_pictures = 0;
+	vmeta_dec->num_engine_streams = 0;
+	vmeta_dec->last_output_pts = GST_CLOCK_TIME_NONE;
+	vmeta_dec->last_output_duration = GST_CLOCK_TIME_NONE;
+	vmeta_dec->frames_finished = FALSE;
+	vmeta_dec->qos_keyframes_only = FALSE;
+	vmeta_dec->qos_resync = FALSE;
+	g_atomic_int_set(&(vmeta_dec->error_recovery), FALSE);
 
 	return ret;
 }
@@ -1279,12 +4168,29 @@ static gboolean gst_vmeta_dec_decide_allocation(GstVideoDecoder *decoder, GstQue
 	guint size, min = 0, max = 0;
 	GstStructure *config;
 	GstVideoInfo vinfo;
-	gboolean update_pool;
+	gboolean update_pool, export_dmabuf;
+	guint num_required_pictures, extra_output_buffers, num_cached_pictures;
 
 	gst_query_parse_allocation(query, &outcaps, NULL);
 	gst_video_info_init(&vinfo);
 	gst_video_info_from_caps(&vinfo, outcaps);
 
+	GST_OBJECT_LOCK(vmeta_dec);
+	export_dmabuf = vmeta_dec->export_dmabuf;
+	GST_OBJECT_UNLOCK(vmeta_dec);
+#ifndef HAVE_VMETA_DMABUF_EXPORT
+	if (export_dmabuf)
+	{
+		GST_WARNING_OBJECT(decoder, "dma-buf export is not supported by this build; using regular buffers");
+		export_dmabuf = FALSE;
+	}
+#endif
+
+	/* Pictures are cropped with metas if downstream supports them (see gst_vmeta_dec_crop_picture()) */
+	vmeta_dec->downstream_video_meta = gst_query_find_allocation_meta(query, GST_VIDEO_META_API_TYPE, NULL);
+	vmeta_dec->downstream_crop_meta = vmeta_dec->downstream_video_meta && gst_query_find_allocation_meta(query, GST_VIDEO_CROP_META_API_TYPE, NULL);
+	GST_DEBUG_OBJECT(decoder, "downstream supports video metas: %s  crop metas: %s", vmeta_dec->downstream_video_meta ? "yes" : "no", vmeta_dec->downstream_crop_meta ? "yes" : "no");
+
 	GST_DEBUG_OBJECT(decoder, "num allocation pools: %d", gst_query_get_n_allocation_pools(query));
 
 	/* Look for an allocator which can allocate vMeta DMA buffers */
@@ -1293,8 +4199,12 @@ static gboolean gst_vmeta_dec_decide_allocation(GstVideoDecoder *decoder, GstQue
 		for (guint i = 0; i < gst_query_get_n_allocation_pools(query); ++i)
 		{
 			gst_query_parse_nth_allocation_pool(query, i, &pool, &size, &min, &max);
-			if (gst_buffer_pool_has_option(pool, GST_BUFFER_POOL_OPTION_MVL_VMETA))
+			if ((pool != NULL) && gst_buffer_pool_has_option(pool, GST_BUFFER_POOL_OPTION_MVL_VMETA))
 				break;
+
+			if (pool != NULL)
+				gst_object_unref(pool);
+			pool = NULL;
 		}
 
 		size = MAX(size, (guint)(vmeta_dec->dec_info.seq_info.dis_buf_size));
@@ -1317,9 +4227,42 @@ static gboolean gst_vmeta_dec_decide_allocation(GstVideoDecoder *decoder, GstQue
 			GST_DEBUG_OBJECT(decoder, "no pool present; creating new pool");
 		else
 			GST_DEBUG_OBJECT(decoder, "no pool supports vMeta buffers; creating new pool");
-		pool = gst_vmeta_buffer_pool_new(GST_VMETA_ALLOCATOR_TYPE_CACHEABLE, TRUE);
+		if (pool != NULL)
+			gst_object_unref(pool);
+
+		/* Prefer the current pool, so a renegotiation after a compatible format change
+		 * does not reallocate all pictures (see below) */
+		pool = gst_video_decoder_get_buffer_pool(decoder);
+		if ((pool != NULL) && (!gst_buffer_pool_has_option(pool, GST_BUFFER_POOL_OPTION_MVL_VMETA) || (GST_IS_VMETA_BUFFER_POOL(pool) && (gst_vmeta_buffer_pool_exports_dmabuf(pool) != export_dmabuf))))
+		{
+			gst_object_unref(pool);
+			pool = NULL;
+		}
+
+		if (pool == NULL)
+			pool = gst_vmeta_buffer_pool_new(GST_VMETA_ALLOCATOR_TYPE_CACHEABLE, TRUE, export_dmabuf);
 	}
 
+	/* Bound the pool size. The minimum number of buffers is preallocated when the pool
+	 * is activated. Setting the maximum to the same value makes the pool block once
+	 * all pictures are in use, instead of allocating more DMA memory. If downstream
+	 * requires more buffers than the configured extra output buffers, use its value. */
+	GST_OBJECT_LOCK(vmeta_dec);
+	extra_output_buffers = vmeta_dec->extra_output_buffers;
+	GST_OBJECT_UNLOCK(vmeta_dec);
+
+	/* The decoder itself may hold back extra pictures (see gst_vmeta_dec_hold_extra_picture()) */
+	num_required_pictures = gst_vmeta_dec_get_num_required_pictures(vmeta_dec) + NUM_HELD_PICTURES;
+	min = num_required_pictures + MAX(min, extra_output_buffers);
+	max = (max == 0) ? min : MAX(max, min);
+
+	/* During reverse playback, the pictures of a whole GOP are held until the GOP is
+	 * finished; these are allocated on demand, up to the reverse cache budget */
+	num_cached_pictures = vmeta_dec->reverse_playback ? gst_vmeta_dec_get_reverse_cache_size(vmeta_dec) : 0;
+	max += num_cached_pictures;
+
+	GST_DEBUG_OBJECT(decoder, "video engine requires %u picture(s), %u extra picture(s) for downstream, %u picture(s) for reverse playback", num_required_pictures, min - num_required_pictures, num_cached_pictures);
+
 	GST_DEBUG_OBJECT(
 		pool,
 		"pool config:  outcaps: %" GST_PTR_FORMAT "  size: %u  min buffers: %u  max buffers: %u",
@@ -1337,11 +4280,40 @@ static gboolean gst_vmeta_dec_decide_allocation(GstVideoDecoder *decoder, GstQue
 		return FALSE;
 	}
 
+	/* An active pool cannot be reconfigured. If its pictures are still usable (for example,
+	 * after a caps change which kept the format, or a resolution change to a smaller size),
+	 * keep using it, and only update the stride and video info; otherwise, replace it. */
+	if (gst_buffer_pool_is_active(pool))
+	{
+		guint pool_size, pool_min, pool_max;
+
+		if (gst_vmeta_dec_can_reuse_pool(pool, size, min, max, &pool_size, &pool_min, &pool_max))
+		{
+			GST_DEBUG_OBJECT(decoder, "reusing active pool %" GST_PTR_FORMAT "  size: %u  min buffers: %u  max buffers: %u", (gpointer)pool, pool_size, pool_min, pool_max);
+
+			gst_vmeta_buffer_pool_set_dis_info(pool, pool_size, vmeta_dec->dec_info.seq_info.dis_stride, vmeta_dec->dec_info.seq_info.max_height);
+			gst_vmeta_buffer_pool_set_video_info(pool, &vinfo);
+
+			if (update_pool)
+				gst_query_set_nth_allocation_pool(query, 0, pool, pool_size, pool_min, pool_max);
+			else
+				gst_query_add_allocation_pool(query, pool, pool_size, pool_min, pool_max);
+
+			gst_object_unref(pool);
+			return TRUE;
+		}
+
+		GST_DEBUG_OBJECT(decoder, "active pool %" GST_PTR_FORMAT " is too small; creating new pool", (gpointer)pool);
+		gst_object_unref(pool);
+		pool = gst_vmeta_buffer_pool_new(GST_VMETA_ALLOCATOR_TYPE_CACHEABLE, TRUE, export_dmabuf);
+	}
+
 	/* Inform the pool about the required stride and DMA buffer size */
 	gst_vmeta_buffer_pool_set_dis_info(
 		pool,
 		vmeta_dec->dec_info.seq_info.dis_buf_size,
-		vmeta_dec->dec_info.seq_info.dis_stride
+		vmeta_dec->dec_info.seq_info.dis_stride,
+		vmeta_dec->dec_info.seq_info.max_height
 	);
 
 	/* Now configure the pool. */
@@ -1363,6 +4335,55 @@ static gboolean gst_vmeta_dec_decide_allocation(GstVideoDecoder *decoder, GstQue
 }
 
 
+static gboolean gst_vmeta_dec_propose_allocation(GstVideoDecoder *decoder, GstQuery *query)
+{
+	GstVmetaDec *vmeta_dec = GST_VMETA_DEC(decoder);
+	GstCaps *caps;
+	GstBufferPool *pool;
+	GstAllocator *allocator;
+	GstAllocationParams params;
+	GstStructure *config;
+	guint headroom;
+
+	gst_query_parse_allocation(query, &caps, NULL);
+
+	/* Offer vMeta DMA memory for the input data. If upstream uses it, input buffers
+	 * can be passed to the video engine without copying (see gst_vmeta_dec_wrap_input_buffer()).
+	 * The headroom reserves space for the codec data and the VC1 frame start code, which
+	 * are prepended to the input data; the padding reserves space for the 0x88 padding bytes.
+	 * The stream start has to be aligned, so the VC1 frame start code is only reserved
+	 * if the input needs it: parsed VC1 frames usually lack it, while unparsed input
+	 * is split at start codes, so every access unit already begins with one. Frames
+	 * with prepended codec data (only the first one) are usually not aligned, and get copied. */
+	headroom = ((vmeta_dec->dec_param_set.strm_fmt == IPP_VIDEO_STRM_FMT_VC1) && !vmeta_dec->unparsed_input) ? 4 : 0;
+	if (vmeta_dec->codec_data != NULL)
+		headroom += ALIGN_VAL_TO(gst_buffer_get_size(vmeta_dec->codec_data), VMETA_STRM_BUF_ALIGN);
+
+	gst_allocation_params_init(&params);
+	params.align = VMETA_STRM_BUF_ALIGN - 1; /* -1 , since align works like a bitmask (internal alignment is align+1) */
+	params.prefix = headroom;
+	params.padding = 128;
+
+	allocator = gst_vmeta_allocator_new(GST_VMETA_ALLOCATOR_TYPE_BUFFERABLE);
+
+	pool = gst_buffer_pool_new();
+	config = gst_buffer_pool_get_config(pool);
+	gst_buffer_pool_config_set_params(config, caps, vmeta_dec->stream_size, 0, 0);
+	gst_buffer_pool_config_set_allocator(config, allocator, &params);
+	gst_buffer_pool_set_config(pool, config);
+
+	GST_DEBUG_OBJECT(vmeta_dec, "proposing stream buffer pool with buffer size %u, headroom %u", vmeta_dec->stream_size, headroom);
+
+	gst_query_add_allocation_pool(query, pool, vmeta_dec->stream_size, 0, 0);
+	gst_query_add_allocation_param(query, allocator, &params);
+
+	gst_object_unref(pool);
+	gst_object_unref(allocator);
+
+	return GST_VIDEO_DECODER_CLASS(gst_vmeta_dec_parent_class)->propose_allocation(decoder, query);
+}
+
+
 static GstStateChangeReturn gst_vmeta_dec_change_state(GstElement * element, GstStateChange transition)
 {
 	GstStateChangeReturn ret;
@@ -1374,6 +4395,11 @@ static GstStateChangeReturn gst_vmeta_dec_change_state(GstElement * element, Gst
 			if (!gst_vmeta_dec_suspend(vmeta_dec, FALSE))
 				return GST_STATE_CHANGE_FAILURE;
 			break;
+		case GST_STATE_CHANGE_PAUSED_TO_READY:
+			/* Stop the decode thread before the base class resets and stops
+			 * the decoder; the stream lock is not held here */
+			gst_vmeta_dec_stop_decode_thread(vmeta_dec, FALSE);
+			break;
 		default:
 			break;
 	}
@@ -26,6 +26,10 @@
 
 #include <codecVC.h>
 
+#include "../common/vmeta_scheduler.h"
+#include "vmeta_bitstream.h"
+#include "vmeta_stream_queue.h"
+
 
 G_BEGIN_DECLS
 
@@ -41,6 +45,10 @@ typedef struct _GstVmetaDecClass GstVmetaDecClass;
 #define GST_IS_VMETA_DEC_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE((klass), GST_TYPE_VMETA_DEC))
 
 
+/* Number of recent access unit sizes used for sizing the stream buffers */
+#define GST_VMETA_DEC_AU_SIZE_HISTORY_LENGTH 64
+
+
 struct _GstVmetaDec
 {
 	GstVideoDecoder parent;
@@ -51,11 +59,63 @@ struct _GstVmetaDec
 	void *dec_state;
 	gboolean is_suspended;
 
-	GList *streams, *streams_available, *streams_ready;
+	GstVmetaSchedulerClient *scheduler_client;
+	gint priority;
 
-	gboolean upload_before_loop;
+	IppVmetaBitstream **streams;
+	guint num_streams;
+	GstVmetaDecStreamQueue streams_available, streams_ready;
+	GMutex streams_mutex;
+	GCond streams_cond;
 
-	GstBuffer *codec_data;
+	guint max_streams, min_stream_size, max_stream_size;
+	guint stream_size;
+	guint au_size_history[GST_VMETA_DEC_AU_SIZE_HISTORY_LENGTH];
+	guint au_size_history_pos, au_size_history_length, num_au_sizes_since_update;
+
+	guint extra_output_buffers;
+	gboolean export_dmabuf;
+	guint dpb_size;
+	gboolean low_latency;
+
+	gboolean upload_before_loop;
+	guint num_expected_pictures;
+	guint num_engine_pictures;
+	guint input_queue_depth, num_engine_streams;
+	GstBuffer *held_picture;
+	gboolean frames_finished;
+	GstClockTime last_output_pts, last_output_duration;
+
+	gboolean decode_thread_enabled, use_decode_thread;
+	GThread *decode_thread;
+	gboolean decode_thread_stop, decode_thread_idle;
+	GstFlowReturn decode_thread_flow_ret;
+
+	GstBuffer *codec_data, *sequence_codec_data;
+	GstVideoCodecState *input_state;
+	GstVideoFormat output_format;
+	gboolean downstream_video_meta, downstream_crop_meta;
+
+	GstVmetaBitstreamParser bitstream_parser;
+	gboolean nal_alignment, unparsed_input;
+	gboolean au_has_picture;
+	gboolean qos_keyframes_only;
+
+	guint reverse_cache_budget;
+	gboolean reverse_playback, reverse_keyframes_only;
+	guint reverse_gop_length, reverse_last_gop_length, reverse_num_cached;
+
+	gboolean error_recovery, qos_resync;
+	guint num_error_recoveries;
+
+	guint64 num_engine_waits;
+	GstClockTime engine_wait_time;
+	guint64 num_decode_calls, num_output_pictures;
+	guint num_merged_uploads;
+
+	guint decode_timeout;
+	GstClockTime hang_stall_time;
+	guint num_hang_recoveries;
 };
 
 
@@ -0,0 +1,63 @@
+/* vMeta video decoder plugin - stream queue
+ * Copyright (C) 2013  Carlos Rafael Giani
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+
+#include "vmeta_stream_queue.h"
+
+
+
+void gst_vmeta_dec_stream_queue_init(GstVmetaDecStreamQueue *queue, guint capacity)
+{
+	queue->items = g_new0(IppVmetaBitstream *, capacity);
+	queue->capacity = capacity;
+	queue->head = 0;
+	queue->length = 0;
+}
+
+
+void gst_vmeta_dec_stream_queue_free(GstVmetaDecStreamQueue *queue)
+{
+	g_free(queue->items);
+	queue->items = NULL;
+	queue->capacity = 0;
+	queue->head = 0;
+	queue->length = 0;
+}
+
+
+void gst_vmeta_dec_stream_queue_push(GstVmetaDecStreamQueue *queue, IppVmetaBitstream *stream)
+{
+	g_assert(queue->length < queue->capacity);
+	queue->items[(queue->head + queue->length) % queue->capacity] = stream;
+	++queue->length;
+}
+
+
+IppVmetaBitstream* gst_vmeta_dec_stream_queue_pop(GstVmetaDecStreamQueue *queue)
+{
+	IppVmetaBitstream *stream;
+
+	if (queue->length == 0)
+		return NULL;
+
+	stream = queue->items[queue->head];
+	queue->head = (queue->head + 1) % queue->capacity;
+	--queue->length;
+
+	return stream;
+}
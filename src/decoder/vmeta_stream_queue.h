@@ -0,0 +1,51 @@
+/* vMeta video decoder plugin - stream queue
+ * Copyright (C) 2013  Carlos Rafael Giani
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+
+#ifndef VMETA_STREAM_QUEUE_H
+#define VMETA_STREAM_QUEUE_H
+
+#include <glib.h>
+
+#include <codecVC.h>
+
+
+G_BEGIN_DECLS
+
+
+/* Fixed-capacity FIFO of streams; the capacity equals the total number of
+ * streams, so pushing can never overflow */
+typedef struct
+{
+	IppVmetaBitstream **items;
+	guint capacity, head, length;
+}
+GstVmetaDecStreamQueue;
+
+
+void gst_vmeta_dec_stream_queue_init(GstVmetaDecStreamQueue *queue, guint capacity);
+void gst_vmeta_dec_stream_queue_free(GstVmetaDecStreamQueue *queue);
+void gst_vmeta_dec_stream_queue_push(GstVmetaDecStreamQueue *queue, IppVmetaBitstream *stream);
+/* Returns NULL if the queue is empty */
+IppVmetaBitstream* gst_vmeta_dec_stream_queue_pop(GstVmetaDecStreamQueue *queue);
+
+
+G_END_DECLS
+
+
+#endif
@@ -0,0 +1,267 @@
+/* vMeta software stand-in - IPP vMeta video codec API
+ * Copyright (C) 2013  Carlos Rafael Giani
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+
+#ifndef VMETASIM_CODECVC_H
+#define VMETASIM_CODECVC_H
+
+/* This header mirrors the subset of Marvell's codecVC.h that is used by the
+ * gst-vmeta plugins. It is only used when configuring with --with-vmeta-sim;
+ * otherwise, the real IPP headers are used. */
+
+#include "misc.h"
+#include "vdec_os_api.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef unsigned char Ipp8u;
+typedef unsigned short Ipp16u;
+typedef unsigned int Ipp32u;
+typedef signed char Ipp8s;
+typedef signed short Ipp16s;
+typedef signed int Ipp32s;
+
+
+#define VMETA_STRM_BUF_ALIGN 8
+#define VMETA_DIS_BUF_ALIGN  16
+
+
+typedef enum
+{
+	IPP_STATUS_INIT_ERR             = -9999,
+	IPP_STATUS_TIMEOUT_ERR          = -17,
+	IPP_STATUS_STREAMFLUSH_ERR      = -16,
+	IPP_STATUS_BUFOVERFLOW_ERR      = -15,
+	IPP_STATUS_NOTSUPPORTED_ERR     = -14,
+	IPP_STATUS_MISALIGNMENT_ERR     = -13,
+	IPP_STATUS_BITSTREAM_ERR        = -12,
+	IPP_STATUS_INPUT_ERR            = -11,
+	IPP_STATUS_SYNCNOTFOUND_ERR     = -10,
+	IPP_STATUS_BADARG_ERR           = -9,
+	IPP_STATUS_NOMEM_ERR            = -8,
+	IPP_STATUS_ERR                  = -7,
+	IPP_STATUS_FRAME_ERR            = -6,
+	IPP_STATUS_FRAME_HEADER_INVALID = -5,
+	IPP_STATUS_FRAME_UNDERRUN       = -4,
+	IPP_STATUS_BUFFER_UNDERRUN      = -3,
+	IPP_STATUS_FATAL_ERR            = -2,
+	IPP_STATUS_DTMF_NOTSUPPORTEDFS  = -1,
+
+	IPP_STATUS_NOERR                = 0,
+	IPP_STATUS_INIT_OK              = 1,
+	IPP_STATUS_FRAME_COMPLETE       = 2,
+	IPP_STATUS_BS_END               = 3,
+	IPP_STATUS_MP4_SHORTHEAD        = 4,
+	IPP_STATUS_READEVENT            = 5,
+	IPP_STATUS_NOTSUPPORTED         = 6,
+	IPP_STATUS_JPEG_EOF             = 7,
+	IPP_STATUS_JPEG_CONTINUE        = 8,
+	IPP_STATUS_OUTPUT_DATA          = 9,
+	IPP_STATUS_NEED_INPUT           = 10,
+	IPP_STATUS_NEW_VIDEO_SEQ        = 11,
+	IPP_STATUS_BUFFER_FULL          = 12,
+	IPP_STATUS_GIF_FINISH           = 13,
+	IPP_STATUS_GIF_MORE             = 14,
+	IPP_STATUS_GIF_NOIMAGE          = 15,
+	IPP_STATUS_FIELD_PICTURE_TOP    = 16,
+	IPP_STATUS_FIELD_PICTURE_BOTTOM = 17,
+	IPP_STATUS_NEED_OUTPUT_BUF      = 18,
+	IPP_STATUS_RETURN_INPUT_BUF     = 19,
+	IPP_STATUS_END_OF_STREAM        = 20,
+	IPP_STATUS_WAIT_FOR_EVENT       = 21,
+	IPP_STATUS_END_OF_PICTURE       = 22
+}
+IppCodecStatus;
+
+
+typedef enum
+{
+	IPP_VIDEO_STRM_FMT_MPG1 = 0,
+	IPP_VIDEO_STRM_FMT_MPG2,
+	IPP_VIDEO_STRM_FMT_MPG4,
+	IPP_VIDEO_STRM_FMT_H261,
+	IPP_VIDEO_STRM_FMT_H263,
+	IPP_VIDEO_STRM_FMT_H264,
+	IPP_VIDEO_STRM_FMT_VC1,
+	IPP_VIDEO_STRM_FMT_VC1M,
+	IPP_VIDEO_STRM_FMT_MJPG
+}
+IppVideoStreamFormat;
+
+
+typedef enum
+{
+	IPP_YCbCr422I = 0,
+	IPP_YCbCr420P,
+	IPP_YCbCr420SP
+}
+IppColorFormat;
+
+
+typedef enum
+{
+	IPPVC_STOP_DECODE_STREAM = 0,
+	IPPVC_PAUSE,
+	IPPVC_RESUME,
+	IPPVC_END_OF_STREAM,
+	IPPVC_SET_VC1M_SEQ_INFO
+}
+IppVideoCmd;
+
+
+typedef enum
+{
+	IPP_VMETA_BUF_TYPE_STRM = 0,
+	IPP_VMETA_BUF_TYPE_PIC
+}
+IppVmetaBufferType;
+
+
+#define IPP_VMETA_STRM_BUF_END_OF_UNIT   0x1
+
+
+typedef struct
+{
+	int x, y;
+	int width, height;
+}
+IppiRect;
+
+
+typedef struct
+{
+	void *ppPicPlane[4];
+	int picWidth;
+	int picHeight;
+	int picPlaneStep[4];
+	int picPlaneNum;
+	int picChannelNum;
+	int picFormat;
+	IppiRect picROI;
+}
+IppiPicture;
+
+
+typedef struct
+{
+	Ipp32u pic_type;
+	Ipp32s coded_type[2];
+	Ipp32s poc[2];
+}
+IppVmetaPicDataInfo;
+
+
+typedef struct
+{
+	Ipp8u *pBuf;
+	Ipp32u nPhyAddr;
+	Ipp32u nBufSize;
+	Ipp32u nDataLen;
+	Ipp32u nOffset;
+	Ipp32u nFlag;
+	void *pUsrData0;
+	void *pUsrData1;
+	void *pUsrData2;
+	void *pUsrData3;
+}
+IppVmetaBitstream;
+
+
+typedef struct
+{
+	Ipp8u *pBuf;
+	Ipp32u nPhyAddr;
+	Ipp32u nBufSize;
+	Ipp32u nDataLen;
+	Ipp32u nOffset;
+	Ipp32u nFlag;
+	void *pUsrData0;
+	void *pUsrData1;
+	void *pUsrData2;
+	void *pUsrData3;
+	IppiPicture pic;
+	IppVmetaPicDataInfo PicDataInfo;
+}
+IppVmetaPicture;
+
+
+typedef struct
+{
+	Ipp32u max_width;
+	Ipp32u max_height;
+	Ipp32u dis_buf_size;
+	Ipp32u dis_stride;
+	IppiRect picROI;
+	Ipp32u is_intl_seq;
+	Ipp32u max_num_dis_buf;  /* number of display buffers the sequence requires (DPB + the one being decoded) */
+}
+IppVmetaDecSeqInfo;
+
+
+typedef struct
+{
+	IppVmetaDecSeqInfo seq_info;
+}
+IppVmetaDecInfo;
+
+
+typedef struct
+{
+	IppVideoStreamFormat strm_fmt;
+	IppColorFormat opt_fmt;
+	Ipp32u no_reordering;
+	Ipp32u bMultiIns;
+	Ipp32u bFirstUser;
+}
+IppVmetaDecParSet;
+
+
+typedef struct
+{
+	unsigned int num_frames;
+	unsigned int vert_size;
+	unsigned int horiz_size;
+	unsigned int level;
+	unsigned int cbr;
+	unsigned int hrd_buffer;
+	unsigned int hrd_rate;
+	unsigned int frame_rate;
+	unsigned char exthdr[32];
+	unsigned int exthdrsize;
+}
+vc1m_seq_header;
+
+
+IppCodecStatus DecoderInitAlloc_Vmeta(IppVmetaDecParSet *pVmetaDecParSet, MiscGeneralCallbackTable *pSrcCallbackTable, void **ppDstDecoderState);
+IppCodecStatus DecoderFree_Vmeta(void **ppSrcDecoderState);
+IppCodecStatus DecodeFrame_Vmeta(IppVmetaDecInfo *pDecInfo, void *pSrcDstDecoderState);
+IppCodecStatus DecodeSendCmd_Vmeta(int cmd, void *pInParam, void *pOutParam, void *pSrcDstDecoderState);
+IppCodecStatus DecoderPushBuffer_Vmeta(IppVmetaBufferType type, void *pBuf, void *pSrcDstDecoderState);
+IppCodecStatus DecoderPopBuffer_Vmeta(IppVmetaBufferType type, void **ppBuf, void *pSrcDstDecoderState);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
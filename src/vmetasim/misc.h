@@ -0,0 +1,49 @@
+/* vMeta software stand-in - IPP miscellaneous callback table
+ * Copyright (C) 2013  Carlos Rafael Giani
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+
+#ifndef VMETASIM_MISC_H
+#define VMETASIM_MISC_H
+
+#include <stddef.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef struct _MiscGeneralCallbackTable
+{
+	void* (*fMemMalloc)(size_t size, unsigned char align);
+	void* (*fMemCalloc)(size_t num, size_t size, unsigned char align);
+	void (*fMemFree)(void **ptr);
+}
+MiscGeneralCallbackTable;
+
+
+int miscInitGeneralCallbackTable(MiscGeneralCallbackTable **table);
+int miscFreeGeneralCallbackTable(MiscGeneralCallbackTable **table);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
@@ -0,0 +1,153 @@
+/* vMeta software stand-in - stream queue benchmark
+ * Copyright (C) 2013  Carlos Rafael Giani
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <glib.h>
+#include "codecVC.h"
+#include "../decoder/vmeta_stream_queue.h"
+
+
+
+/* Measures the cost of moving streams between the decoder's "available" and "ready"
+ * queues, once with the ring queues the decoder uses, and once with the GLists it used
+ * before. Every iteration moves one stream from "available" to "ready" and another one
+ * back, like the decoder does for each uploaded and decoded access unit; "ready" holds
+ * as many streams as the input queue depth allows. */
+
+
+#define DEFAULT_NUM_STREAMS     16
+#define DEFAULT_NUM_ITERATIONS  10000000
+
+
+
+/* the list helpers the decoder used before the ring queues */
+
+static void push_to_list(GList **list, gpointer data)
+{
+	*list = g_list_append(*list, data);
+}
+
+
+static gpointer pop_from_list(GList **list)
+{
+	GList *llink;
+	llink = g_list_first(*list);
+	if (llink == NULL)
+	{
+		return NULL;
+	}
+	else
+	{
+		gpointer data = llink->data;
+		*list = g_list_delete_link(*list, llink);
+		return data;
+	}
+}
+
+
+
+static gint64 bench_ring_queue(IppVmetaBitstream *streams, guint num_streams, guint depth, guint num_iterations)
+{
+	GstVmetaDecStreamQueue available, ready;
+	gint64 start_time, end_time;
+	guint i;
+
+	gst_vmeta_dec_stream_queue_init(&available, num_streams);
+	gst_vmeta_dec_stream_queue_init(&ready, num_streams);
+
+	for (i = 0; i < num_streams; ++i)
+		gst_vmeta_dec_stream_queue_push((i < depth) ? &ready : &available, &(streams[i]));
+
+	start_time = g_get_monotonic_time();
+	for (i = 0; i < num_iterations; ++i)
+	{
+		gst_vmeta_dec_stream_queue_push(&ready, gst_vmeta_dec_stream_queue_pop(&available));
+		gst_vmeta_dec_stream_queue_push(&available, gst_vmeta_dec_stream_queue_pop(&ready));
+	}
+	end_time = g_get_monotonic_time();
+
+	gst_vmeta_dec_stream_queue_free(&available);
+	gst_vmeta_dec_stream_queue_free(&ready);
+
+	return end_time - start_time;
+}
+
+
+static gint64 bench_list(IppVmetaBitstream *streams, guint num_streams, guint depth, guint num_iterations)
+{
+	GList *available = NULL, *ready = NULL;
+	gint64 start_time, end_time;
+	guint i;
+
+	for (i = 0; i < num_streams; ++i)
+		push_to_list((i < depth) ? &ready : &available, &(streams[i]));
+
+	start_time = g_get_monotonic_time();
+	for (i = 0; i < num_iterations; ++i)
+	{
+		push_to_list(&ready, pop_from_list(&available));
+		push_to_list(&available, pop_from_list(&ready));
+	}
+	end_time = g_get_monotonic_time();
+
+	g_list_free(available);
+	g_list_free(ready);
+
+	return end_time - start_time;
+}
+
+
+int main(int argc, char *argv[])
+{
+	IppVmetaBitstream *streams;
+	guint num_streams, num_iterations, depth;
+
+	num_streams = (argc > 1) ? (guint)atoi(argv[1]) : DEFAULT_NUM_STREAMS;
+	num_iterations = (argc > 2) ? (guint)atoi(argv[2]) : DEFAULT_NUM_ITERATIONS;
+
+	if ((num_streams < 2) || (num_iterations == 0))
+	{
+		fprintf(stderr, "usage: %s [number of streams (>= 2)] [number of iterations (> 0)]\n", argv[0]);
+		return -1;
+	}
+
+	streams = g_new0(IppVmetaBitstream, num_streams);
+
+	printf("%u streams, %u iterations; times are per push/pop pair\n\n", num_streams, num_iterations);
+	printf("ready streams   ring queue   GList\n");
+
+	/* "available" must never run empty, so at most num_streams - 1 streams are ready */
+	for (depth = 1; depth < num_streams; depth *= 2)
+	{
+		gint64 ring_time = bench_ring_queue(streams, num_streams, depth, num_iterations);
+		gint64 list_time = bench_list(streams, num_streams, depth, num_iterations);
+
+		printf(
+			"%13u   %7.2f ns   %7.2f ns\n",
+			depth,
+			ring_time * 1000.0 / (num_iterations * 2.0),
+			list_time * 1000.0 / (num_iterations * 2.0)
+		);
+	}
+
+	g_free(streams);
+
+	return 0;
+}
@@ -0,0 +1,68 @@
+/* vMeta software stand-in - vdec OS API (DMA memory)
+ * Copyright (C) 2013  Carlos Rafael Giani
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+
+#ifndef VMETASIM_VDEC_OS_API_H
+#define VMETASIM_VDEC_OS_API_H
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef unsigned int UNSG32;
+typedef signed int SIGN32;
+
+
+/* directions for vdec_os_api_flush_cache() */
+#define DMA_BIDIRECTIONAL  0
+#define DMA_TO_DEVICE      1
+#define DMA_FROM_DEVICE    2
+
+
+/* All three allocation variants return page-aligned memory; the cache attributes
+ * of the real hardware have no meaning here. The physical addresses are fake,
+ * but unique and stable for the lifetime of the block, so code which uses them
+ * as keys (like the vmetaxvsink) behaves as it would on the real hardware. */
+void* vdec_os_api_dma_alloc(UNSG32 size, UNSG32 align, UNSG32 *pPhysical);
+void* vdec_os_api_dma_alloc_cached(UNSG32 size, UNSG32 align, UNSG32 *pPhysical);
+void* vdec_os_api_dma_alloc_writecombine(UNSG32 size, UNSG32 align, UNSG32 *pPhysical);
+void vdec_os_api_dma_free(void *ptr);
+
+/* Returns a new dma-buf file descriptor for a block allocated with one of the functions
+ * above, or -1 if it cannot be exported; the caller has to close it. Here, the blocks are
+ * backed by memfds, which can be mapped and passed around like dma-bufs. */
+int vdec_os_api_dma_export_fd(void *ptr);
+
+UNSG32 vdec_os_api_flush_cache(UNSG32 vaddr, UNSG32 size, int direction);
+
+int vdec_os_api_suspend_check(void);
+void vdec_os_api_suspend_ready(void);
+
+/* Blocks until the engine signals an event (like the completion of a frame);
+ * returns 0 on success, and a negative value on timeout or error */
+SIGN32 vdec_os_api_sync_event(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
@@ -0,0 +1,960 @@
+/* vMeta software stand-in
+ * Copyright (C) 2013  Carlos Rafael Giani
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "codecVC.h"
+#include "vdec_os_api.h"
+#include "misc.h"
+
+
+
+/* This is a software stand-in for the parts of Marvell's IPP vMeta API and the vdec OS API
+ * which are used by the gst-vmeta plugins. It does not decode anything. Instead, it
+ * mimics the observable behavior of the engine:
+ *
+ * - DMA memory is backed by memfd (or anonymous memory if memfd is unavailable), and gets
+ *   fake, unique physical addresses
+ * - DecodeFrame_Vmeta() follows the same status code protocol as the real engine
+ *   (NEW_VIDEO_SEQ, NEED_INPUT, NEED_OUTPUT_BUF, WAIT_FOR_EVENT, RETURN_INPUT_BUF,
+ *   FRAME_COMPLETE, END_OF_STREAM)
+ * - each stream takes a configurable amount of "engine time" to decode; during this time,
+ *   DecodeFrame_Vmeta() returns IPP_STATUS_WAIT_FOR_EVENT, and vdec_os_api_sync_event()
+ *   blocks until the engine is done
+ * - there is one engine per process; decoder instances share its time, and a second instance
+ *   can only be created if all instances are opened in multi-instance mode (bMultiIns)
+ * - decoded pictures are held in a DPB of configurable depth before they are output,
+ *   unless no_reordering is set
+ * - for MJPEG, the picture size is taken from the JPEG frame header; if it changes in the
+ *   middle of the stream, the held pictures are output, and a new sequence is started
+ * - output pictures are filled with a synthetic UYVY pattern
+ * - bitstream errors can be injected, which are reported with IPP_STATUS_BITSTREAM_ERR
+ *   after the affected frame was decoded
+ * - engine hangs can be injected; a hung frame never finishes, vdec_os_api_sync_event()
+ *   times out, and only IPPVC_STOP_DECODE_STREAM aborts the frame
+ *
+ * This makes it possible to measure the overhead of the plugins (handle_frame, allocations,
+ * pipeline throughput) on any Linux machine. The behavior is controlled by environment
+ * variables, which are read in DecoderInitAlloc_Vmeta():
+ *
+ * VMETASIM_WIDTH, VMETASIM_HEIGHT : size of the decoded pictures (default: 1280x720);
+ *                                   ignored for WMV3, which gets its size from the sequence header
+ * VMETASIM_LATENCY_US             : engine time per frame, in microseconds (default: 0)
+ * VMETASIM_DPB_SIZE               : number of pictures held for reordering (default: 2)
+ * VMETASIM_FILL                   : if 0, pictures are not filled (default: 1)
+ * VMETASIM_ERROR_INTERVAL         : if nonzero, every Nth frame is reported as containing
+ *                                   a bitstream error (default: 0)
+ * VMETASIM_HANG_INTERVAL          : if nonzero, the engine hangs at every Nth frame of a
+ *                                   decoder instance (default: 0)
+ * VMETASIM_STATS                  : if 1, statistics are printed to stderr when a decoder
+ *                                   is freed (default: 0)
+ */
+
+
+
+#define SIM_QUEUE_CAPACITY 64
+#define SIM_PHYS_ADDR_BASE 0x10000000U
+#define SIM_SYNC_EVENT_TIMEOUT_US 10000
+#define SIM_ALIGN_VAL_TO(LENGTH, ALIGN_SIZE)  ( (((LENGTH) + (ALIGN_SIZE) - 1) / (ALIGN_SIZE)) * (ALIGN_SIZE) )
+
+
+
+/*************************/
+/* environment variables */
+
+static unsigned int sim_getenv_uint(char const *name, unsigned int default_value)
+{
+	char const *str = getenv(name);
+	char *endptr;
+	unsigned long value;
+
+	if ((str == NULL) || (*str == 0))
+		return default_value;
+
+	value = strtoul(str, &endptr, 10);
+	if (*endptr != 0)
+		return default_value;
+
+	return (unsigned int)value;
+}
+
+
+static unsigned long long sim_now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)(ts.tv_sec) * 1000000ULL + (unsigned long long)(ts.tv_nsec) / 1000ULL;
+}
+
+
+
+
+/**************/
+/* DMA memory */
+
+typedef struct _SimDmaBlock SimDmaBlock;
+
+struct _SimDmaBlock
+{
+	void *virt_addr;
+	UNSG32 phys_addr;
+	size_t size;
+	int fd;
+	SimDmaBlock *next;
+};
+
+
+static pthread_mutex_t sim_dma_mutex = PTHREAD_MUTEX_INITIALIZER;
+static SimDmaBlock *sim_dma_blocks = NULL;
+static UNSG32 sim_next_phys_addr = SIM_PHYS_ADDR_BASE;
+static unsigned long sim_dma_num_allocs = 0, sim_dma_num_frees = 0;
+static size_t sim_dma_cur_bytes = 0, sim_dma_peak_bytes = 0;
+
+
+static void* sim_dma_alloc(UNSG32 size, UNSG32 align, UNSG32 *pPhysical)
+{
+	SimDmaBlock *block;
+	size_t page_size, mapped_size;
+	void *addr;
+	int fd = -1;
+
+	if (size == 0)
+		return NULL;
+
+	page_size = (size_t)sysconf(_SC_PAGESIZE);
+	/* mmap'd memory is page aligned; bigger alignments are not needed by the plugins */
+	if ((align > 0) && (page_size % align) != 0)
+		return NULL;
+
+	mapped_size = SIM_ALIGN_VAL_TO((size_t)size, page_size);
+
+#ifdef MFD_CLOEXEC
+	fd = memfd_create("vmetasim-dma", MFD_CLOEXEC);
+	if ((fd >= 0) && (ftruncate(fd, mapped_size) != 0))
+	{
+		close(fd);
+		fd = -1;
+	}
+#endif
+
+	if (fd >= 0)
+		addr = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	else
+		addr = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (addr == MAP_FAILED)
+	{
+		if (fd >= 0)
+			close(fd);
+		return NULL;
+	}
+
+	block = malloc(sizeof(SimDmaBlock));
+	if (block == NULL)
+	{
+		munmap(addr, mapped_size);
+		if (fd >= 0)
+			close(fd);
+		return NULL;
+	}
+
+	block->virt_addr = addr;
+	block->size = mapped_size;
+	block->fd = fd;
+
+	pthread_mutex_lock(&sim_dma_mutex);
+	block->phys_addr = sim_next_phys_addr;
+	sim_next_phys_addr += mapped_size;
+	block->next = sim_dma_blocks;
+	sim_dma_blocks = block;
+	++sim_dma_num_allocs;
+	sim_dma_cur_bytes += mapped_size;
+	if (sim_dma_cur_bytes > sim_dma_peak_bytes)
+		sim_dma_peak_bytes = sim_dma_cur_bytes;
+	pthread_mutex_unlock(&sim_dma_mutex);
+
+	if (pPhysical != NULL)
+		*pPhysical = block->phys_addr;
+
+	return addr;
+}
+
+
+void* vdec_os_api_dma_alloc(UNSG32 size, UNSG32 align, UNSG32 *pPhysical)
+{
+	return sim_dma_alloc(size, align, pPhysical);
+}
+
+
+void* vdec_os_api_dma_alloc_cached(UNSG32 size, UNSG32 align, UNSG32 *pPhysical)
+{
+	return sim_dma_alloc(size, align, pPhysical);
+}
+
+
+void* vdec_os_api_dma_alloc_writecombine(UNSG32 size, UNSG32 align, UNSG32 *pPhysical)
+{
+	return sim_dma_alloc(size, align, pPhysical);
+}
+
+
+void vdec_os_api_dma_free(void *ptr)
+{
+	SimDmaBlock **link, *block = NULL;
+
+	if (ptr == NULL)
+		return;
+
+	pthread_mutex_lock(&sim_dma_mutex);
+	for (link = &sim_dma_blocks; *link != NULL; link = &((*link)->next))
+	{
+		if ((*link)->virt_addr == ptr)
+		{
+			block = *link;
+			*link = block->next;
+			++sim_dma_num_frees;
+			sim_dma_cur_bytes -= block->size;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&sim_dma_mutex);
+
+	if (block == NULL)
+	{
+		fprintf(stderr, "vmetasim: attempted to free unknown DMA block %p\n", ptr);
+		return;
+	}
+
+	munmap(block->virt_addr, block->size);
+	if (block->fd >= 0)
+		close(block->fd);
+	free(block);
+}
+
+
+int vdec_os_api_dma_export_fd(void *ptr)
+{
+	SimDmaBlock *block;
+	int fd = -1;
+
+	pthread_mutex_lock(&sim_dma_mutex);
+	for (block = sim_dma_blocks; block != NULL; block = block->next)
+	{
+		if (block->virt_addr == ptr)
+		{
+			/* the memfd stands in for the dma-buf; without memfd support, nothing can be exported */
+			if (block->fd >= 0)
+				fd = fcntl(block->fd, F_DUPFD_CLOEXEC, 0);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&sim_dma_mutex);
+
+	return fd;
+}
+
+
+UNSG32 vdec_os_api_flush_cache(UNSG32 vaddr, UNSG32 size, int direction)
+{
+	(void)vaddr;
+	(void)size;
+	(void)direction;
+	return 0;
+}
+
+
+int vdec_os_api_suspend_check(void)
+{
+	return 0;
+}
+
+
+void vdec_os_api_suspend_ready(void)
+{
+}
+
+
+
+
+/***********************/
+/* misc callback table */
+
+static void* sim_mem_malloc(size_t size, unsigned char align)
+{
+	void *ptr;
+	if (posix_memalign(&ptr, (align < sizeof(void*)) ? sizeof(void*) : align, size) != 0)
+		return NULL;
+	return ptr;
+}
+
+
+static void* sim_mem_calloc(size_t num, size_t size, unsigned char align)
+{
+	void *ptr = sim_mem_malloc(num * size, align);
+	if (ptr != NULL)
+		memset(ptr, 0, num * size);
+	return ptr;
+}
+
+
+static void sim_mem_free(void **ptr)
+{
+	free(*ptr);
+	*ptr = NULL;
+}
+
+
+int miscInitGeneralCallbackTable(MiscGeneralCallbackTable **table)
+{
+	*table = malloc(sizeof(MiscGeneralCallbackTable));
+	if (*table == NULL)
+		return -1;
+
+	(*table)->fMemMalloc = sim_mem_malloc;
+	(*table)->fMemCalloc = sim_mem_calloc;
+	(*table)->fMemFree = sim_mem_free;
+
+	return 0;
+}
+
+
+int miscFreeGeneralCallbackTable(MiscGeneralCallbackTable **table)
+{
+	free(*table);
+	*table = NULL;
+	return 0;
+}
+
+
+
+
+/********************/
+/* decoder "engine" */
+
+typedef struct
+{
+	void *items[SIM_QUEUE_CAPACITY];
+	unsigned int head, length;
+}
+SimQueue;
+
+
+typedef struct
+{
+	IppVmetaDecParSet params;
+
+	unsigned int width, height;
+	unsigned int latency_us;
+	unsigned int dpb_size;
+	int fill_pictures;
+	int print_stats;
+	unsigned int error_interval;
+	int error_pending;
+	unsigned int hang_interval;
+	int hung;
+
+	int seq_initialized;
+	int eos;
+	int stopped;
+
+	SimQueue streams_in, streams_out;
+	SimQueue pictures_free, pictures_dpb, pictures_out;
+
+	IppVmetaBitstream *cur_stream;
+	IppVmetaPicture *cur_picture;
+	unsigned long long cur_deadline;
+
+	unsigned char *row_pattern;
+	size_t row_pattern_size;
+
+	unsigned long frame_counter, num_started_frames;
+	unsigned long num_decode_calls, num_wait_events;
+	unsigned long long busy_us;
+}
+SimDecoder;
+
+
+/* The one engine all decoder instances share; frames of different instances are
+ * decoded one after the other, never in parallel */
+static pthread_mutex_t sim_engine_mutex = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long long sim_engine_busy_until = 0;
+static unsigned int sim_engine_num_instances = 0;
+static unsigned int sim_engine_num_hung = 0;
+static int sim_engine_single_instance = 0;
+
+
+/* The engine raises its interrupt once it has finished all frames it was given; since the
+ * plugins let only one instance drive the engine at a time, this is the completion event
+ * of the frame the caller is waiting for. This belongs to the vdec OS API, but needs the
+ * engine state. */
+SIGN32 vdec_os_api_sync_event(void)
+{
+	unsigned long long now, busy_until;
+	unsigned int num_hung;
+
+	pthread_mutex_lock(&sim_engine_mutex);
+	busy_until = sim_engine_busy_until;
+	num_hung = sim_engine_num_hung;
+	pthread_mutex_unlock(&sim_engine_mutex);
+
+	now = sim_now_us();
+	if (busy_until > now)
+		usleep((useconds_t)(busy_until - now));
+	else if (num_hung > 0)
+	{
+		/* A hung engine never raises its interrupt; the wait times out */
+		usleep(SIM_SYNC_EVENT_TIMEOUT_US);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+static int sim_queue_push(SimQueue *queue, void *item)
+{
+	if (queue->length >= SIM_QUEUE_CAPACITY)
+		return 0;
+	queue->items[(queue->head + queue->length) % SIM_QUEUE_CAPACITY] = item;
+	++queue->length;
+	return 1;
+}
+
+
+static void* sim_queue_pop(SimQueue *queue)
+{
+	void *item;
+	if (queue->length == 0)
+		return NULL;
+	item = queue->items[queue->head];
+	queue->head = (queue->head + 1) % SIM_QUEUE_CAPACITY;
+	--queue->length;
+	return item;
+}
+
+
+static void sim_fill_seq_info(SimDecoder *dec, IppVmetaDecInfo *info)
+{
+	unsigned int aligned_width = SIM_ALIGN_VAL_TO(dec->width, 16);
+	unsigned int aligned_height = SIM_ALIGN_VAL_TO(dec->height, 16);
+
+	memset(&(info->seq_info), 0, sizeof(IppVmetaDecSeqInfo));
+	info->seq_info.max_width = aligned_width;
+	info->seq_info.max_height = aligned_height;
+	if (dec->params.opt_fmt == IPP_YCbCr422I)
+	{
+		info->seq_info.dis_stride = aligned_width * 2;
+		info->seq_info.dis_buf_size = info->seq_info.dis_stride * aligned_height;
+	}
+	else
+	{
+		/* planar and semi-planar 4:2:0: the chroma follows the luma plane */
+		info->seq_info.dis_stride = aligned_width;
+		info->seq_info.dis_buf_size = info->seq_info.dis_stride * aligned_height * 3 / 2;
+	}
+	info->seq_info.picROI.x = 0;
+	info->seq_info.picROI.y = 0;
+	info->seq_info.picROI.width = dec->width;
+	info->seq_info.picROI.height = dec->height;
+	info->seq_info.max_num_dis_buf = dec->dpb_size + 1;
+}
+
+
+static void sim_render_picture(SimDecoder *dec, IppVmetaPicture *picture)
+{
+	int planar = (dec->params.opt_fmt != IPP_YCbCr422I);
+	unsigned int stride = SIM_ALIGN_VAL_TO(dec->width, 16) * (planar ? 1 : 2);
+	unsigned int num_rows = SIM_ALIGN_VAL_TO(dec->height, 16);
+	unsigned int luma_size = stride * num_rows;
+	unsigned int x, y;
+
+	picture->nDataLen = planar ? (luma_size * 3 / 2) : luma_size;
+	picture->nOffset = 0;
+	picture->pic.picWidth = dec->width;
+	picture->pic.picHeight = dec->height;
+	picture->pic.picFormat = dec->params.opt_fmt;
+	picture->pic.picPlaneStep[0] = stride;
+	picture->pic.ppPicPlane[0] = picture->pBuf;
+	switch (dec->params.opt_fmt)
+	{
+		case IPP_YCbCr420P:
+			picture->pic.picPlaneNum = 3;
+			picture->pic.picChannelNum = 3;
+			picture->pic.picPlaneStep[1] = picture->pic.picPlaneStep[2] = stride / 2;
+			picture->pic.ppPicPlane[1] = picture->pBuf + luma_size;
+			picture->pic.ppPicPlane[2] = picture->pBuf + luma_size + luma_size / 4;
+			break;
+		case IPP_YCbCr420SP:
+			picture->pic.picPlaneNum = 2;
+			picture->pic.picChannelNum = 3;
+			picture->pic.picPlaneStep[1] = stride;
+			picture->pic.ppPicPlane[1] = picture->pBuf + luma_size;
+			break;
+		default:
+			picture->pic.picPlaneNum = 1;
+			picture->pic.picChannelNum = 1;
+			break;
+	}
+	picture->pic.picROI.x = 0;
+	picture->pic.picROI.y = 0;
+	picture->pic.picROI.width = dec->width;
+	picture->pic.picROI.height = dec->height;
+	picture->PicDataInfo.pic_type = 0;
+	picture->PicDataInfo.poc[0] = picture->PicDataInfo.poc[1] = (Ipp32s)(dec->frame_counter * 2);
+
+	if (!dec->fill_pictures || (picture->nBufSize < picture->nDataLen))
+		return;
+
+	if (dec->row_pattern_size < stride)
+	{
+		free(dec->row_pattern);
+		dec->row_pattern = malloc(stride);
+		dec->row_pattern_size = (dec->row_pattern != NULL) ? stride : 0;
+		if (dec->row_pattern == NULL)
+			return;
+	}
+
+	/* A horizontal luma ramp which scrolls with each frame, neutral chroma */
+	if (planar)
+	{
+		for (x = 0; x < stride; ++x)
+			dec->row_pattern[x] = (unsigned char)((x + dec->frame_counter * 4) & 0xff);
+	}
+	else
+	{
+		for (x = 0; x < stride; x += 4)
+		{
+			unsigned char luma = (unsigned char)((x / 2 + dec->frame_counter * 4) & 0xff);
+			dec->row_pattern[x + 0] = 128;
+			dec->row_pattern[x + 1] = luma;
+			dec->row_pattern[x + 2] = 128;
+			dec->row_pattern[x + 3] = luma;
+		}
+	}
+
+	for (y = 0; y < num_rows; ++y)
+		memcpy(picture->pBuf + y * stride, dec->row_pattern, stride);
+
+	/* Both chroma layouts take up half the luma size, and are all neutral */
+	if (planar)
+		memset(picture->pBuf + luma_size, 128, luma_size / 2);
+}
+
+
+static int sim_parse_jpeg_size(IppVmetaBitstream *stream, unsigned int *width, unsigned int *height)
+{
+	Ipp32u i;
+
+	/* look for a SOF0/SOF1/SOF2 marker; the frame size follows the precision byte */
+	for (i = 0; (i + 8) < stream->nDataLen; ++i)
+	{
+		Ipp8u *p = stream->pBuf + i;
+		if ((p[0] == 0xFF) && (p[1] >= 0xC0) && (p[1] <= 0xC2))
+		{
+			*height = (p[5] << 8) | p[6];
+			*width = (p[7] << 8) | p[8];
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+
+static void sim_finish_current(SimDecoder *dec)
+{
+	if (dec->cur_picture != NULL)
+	{
+		sim_render_picture(dec, dec->cur_picture);
+		sim_queue_push(&(dec->pictures_dpb), dec->cur_picture);
+		++dec->frame_counter;
+
+		if ((dec->error_interval > 0) && ((dec->frame_counter % dec->error_interval) == 0))
+			dec->error_pending = 1;
+	}
+
+	dec->cur_stream->nDataLen = 0;
+	sim_queue_push(&(dec->streams_out), dec->cur_stream);
+
+	dec->cur_stream = NULL;
+	dec->cur_picture = NULL;
+
+	/* Pictures leave the DPB once it holds more than the reorder depth */
+	while (dec->pictures_dpb.length > (dec->params.no_reordering ? 0 : dec->dpb_size))
+		sim_queue_push(&(dec->pictures_out), sim_queue_pop(&(dec->pictures_dpb)));
+}
+
+
+IppCodecStatus DecoderInitAlloc_Vmeta(IppVmetaDecParSet *pVmetaDecParSet, MiscGeneralCallbackTable *pSrcCallbackTable, void **ppDstDecoderState)
+{
+	SimDecoder *dec;
+
+	if ((pVmetaDecParSet == NULL) || (pSrcCallbackTable == NULL) || (ppDstDecoderState == NULL))
+		return IPP_STATUS_BADARG_ERR;
+
+	dec = calloc(1, sizeof(SimDecoder));
+	if (dec == NULL)
+		return IPP_STATUS_NOMEM_ERR;
+
+	dec->params = *pVmetaDecParSet;
+	dec->width = sim_getenv_uint("VMETASIM_WIDTH", 1280);
+	dec->height = sim_getenv_uint("VMETASIM_HEIGHT", 720);
+	dec->latency_us = sim_getenv_uint("VMETASIM_LATENCY_US", 0);
+	dec->dpb_size = sim_getenv_uint("VMETASIM_DPB_SIZE", 2);
+	dec->fill_pictures = sim_getenv_uint("VMETASIM_FILL", 1);
+	dec->print_stats = sim_getenv_uint("VMETASIM_STATS", 0);
+	dec->error_interval = sim_getenv_uint("VMETASIM_ERROR_INTERVAL", 0);
+	dec->hang_interval = sim_getenv_uint("VMETASIM_HANG_INTERVAL", 0);
+
+	if ((dec->width == 0) || (dec->height == 0))
+	{
+		free(dec);
+		return IPP_STATUS_BADARG_ERR;
+	}
+
+	pthread_mutex_lock(&sim_engine_mutex);
+	if ((sim_engine_num_instances > 0) && (sim_engine_single_instance || !dec->params.bMultiIns))
+	{
+		pthread_mutex_unlock(&sim_engine_mutex);
+		free(dec);
+		return IPP_STATUS_NOTSUPPORTED_ERR;
+	}
+	if (sim_engine_num_instances == 0)
+		sim_engine_single_instance = !dec->params.bMultiIns;
+	++sim_engine_num_instances;
+	pthread_mutex_unlock(&sim_engine_mutex);
+
+	*ppDstDecoderState = dec;
+
+	return IPP_STATUS_NOERR;
+}
+
+
+IppCodecStatus DecoderFree_Vmeta(void **ppSrcDecoderState)
+{
+	SimDecoder *dec;
+
+	if ((ppSrcDecoderState == NULL) || (*ppSrcDecoderState == NULL))
+		return IPP_STATUS_BADARG_ERR;
+
+	dec = (SimDecoder *)(*ppSrcDecoderState);
+
+	if (dec->print_stats)
+	{
+		pthread_mutex_lock(&sim_dma_mutex);
+		fprintf(
+			stderr,
+			"vmetasim: frames: %lu  DecodeFrame calls: %lu  wait events: %lu  engine busy: %llu us  "
+			"DMA allocs: %lu  DMA frees: %lu  DMA bytes in use: %zu  DMA peak bytes: %zu\n",
+			dec->frame_counter,
+			dec->num_decode_calls,
+			dec->num_wait_events,
+			dec->busy_us,
+			sim_dma_num_allocs,
+			sim_dma_num_frees,
+			sim_dma_cur_bytes,
+			sim_dma_peak_bytes
+		);
+		pthread_mutex_unlock(&sim_dma_mutex);
+	}
+
+	pthread_mutex_lock(&sim_engine_mutex);
+	--sim_engine_num_instances;
+	if (dec->hung)
+		--sim_engine_num_hung;
+	pthread_mutex_unlock(&sim_engine_mutex);
+
+	free(dec->row_pattern);
+	free(dec);
+	*ppSrcDecoderState = NULL;
+
+	return IPP_STATUS_NOERR;
+}
+
+
+IppCodecStatus DecodeFrame_Vmeta(IppVmetaDecInfo *pDecInfo, void *pSrcDstDecoderState)
+{
+	SimDecoder *dec = (SimDecoder *)pSrcDstDecoderState;
+
+	if ((dec == NULL) || (pDecInfo == NULL))
+		return IPP_STATUS_BADARG_ERR;
+
+	++dec->num_decode_calls;
+
+	if (dec->cur_stream != NULL)
+	{
+		unsigned long long now = sim_now_us();
+		if (now < dec->cur_deadline)
+		{
+			++dec->num_wait_events;
+			return IPP_STATUS_WAIT_FOR_EVENT;
+		}
+
+		sim_finish_current(dec);
+	}
+
+	if (dec->error_pending)
+	{
+		dec->error_pending = 0;
+		return IPP_STATUS_BITSTREAM_ERR;
+	}
+
+	if (dec->streams_out.length > 0)
+		return IPP_STATUS_RETURN_INPUT_BUF;
+
+	if (dec->pictures_out.length > 0)
+		return IPP_STATUS_FRAME_COMPLETE;
+
+	if (dec->streams_in.length == 0)
+	{
+		if (dec->eos)
+		{
+			if (dec->pictures_dpb.length > 0)
+			{
+				sim_queue_push(&(dec->pictures_out), sim_queue_pop(&(dec->pictures_dpb)));
+				return IPP_STATUS_FRAME_COMPLETE;
+			}
+
+			dec->eos = 0;
+			return IPP_STATUS_END_OF_STREAM;
+		}
+
+		return IPP_STATUS_NEED_INPUT;
+	}
+
+	if (dec->seq_initialized && (dec->params.strm_fmt == IPP_VIDEO_STRM_FMT_MJPG))
+	{
+		unsigned int width, height;
+
+		if (sim_parse_jpeg_size((IppVmetaBitstream *)(dec->streams_in.items[dec->streams_in.head]), &width, &height)
+		 && ((width != dec->width) || (height != dec->height)))
+		{
+			/* The pictures of the old sequence are output before the new one starts */
+			if (dec->pictures_dpb.length > 0)
+			{
+				while (dec->pictures_dpb.length > 0)
+					sim_queue_push(&(dec->pictures_out), sim_queue_pop(&(dec->pictures_dpb)));
+				return IPP_STATUS_FRAME_COMPLETE;
+			}
+
+			dec->seq_initialized = 0;
+		}
+	}
+
+	if (!dec->seq_initialized)
+	{
+		if (dec->params.strm_fmt == IPP_VIDEO_STRM_FMT_MJPG)
+			sim_parse_jpeg_size((IppVmetaBitstream *)(dec->streams_in.items[dec->streams_in.head]), &(dec->width), &(dec->height));
+
+		sim_fill_seq_info(dec, pDecInfo);
+		dec->seq_initialized = 1;
+		return IPP_STATUS_NEW_VIDEO_SEQ;
+	}
+
+	if (dec->pictures_free.length == 0)
+		return IPP_STATUS_NEED_OUTPUT_BUF;
+
+	dec->cur_stream = sim_queue_pop(&(dec->streams_in));
+	dec->cur_picture = sim_queue_pop(&(dec->pictures_free));
+	++dec->num_started_frames;
+
+	/* A hung frame never reaches its deadline, and does not occupy the engine
+	 * for the other instances (they would hang as well otherwise) */
+	if ((dec->hang_interval > 0) && ((dec->num_started_frames % dec->hang_interval) == 0))
+	{
+		pthread_mutex_lock(&sim_engine_mutex);
+		++sim_engine_num_hung;
+		pthread_mutex_unlock(&sim_engine_mutex);
+		dec->hung = 1;
+		dec->cur_deadline = ULLONG_MAX;
+		++dec->num_wait_events;
+		return IPP_STATUS_WAIT_FOR_EVENT;
+	}
+
+	/* The frame starts once the engine has finished the frames of all instances before it */
+	pthread_mutex_lock(&sim_engine_mutex);
+	dec->cur_deadline = sim_now_us();
+	if (dec->cur_deadline < sim_engine_busy_until)
+		dec->cur_deadline = sim_engine_busy_until;
+	dec->cur_deadline += dec->latency_us;
+	sim_engine_busy_until = dec->cur_deadline;
+	pthread_mutex_unlock(&sim_engine_mutex);
+	dec->busy_us += dec->latency_us;
+
+	if (dec->latency_us > 0)
+	{
+		++dec->num_wait_events;
+		return IPP_STATUS_WAIT_FOR_EVENT;
+	}
+
+	sim_finish_current(dec);
+	return IPP_STATUS_RETURN_INPUT_BUF;
+}
+
+
+IppCodecStatus DecodeSendCmd_Vmeta(int cmd, void *pInParam, void *pOutParam, void *pSrcDstDecoderState)
+{
+	SimDecoder *dec = (SimDecoder *)pSrcDstDecoderState;
+
+	(void)pOutParam;
+
+	if (dec == NULL)
+		return IPP_STATUS_BADARG_ERR;
+
+	switch (cmd)
+	{
+		case IPPVC_STOP_DECODE_STREAM:
+			/* Engine stops, and aborts the ongoing decode (even a hung one);
+			 * all buffers can be popped afterwards */
+			if (dec->cur_stream != NULL)
+			{
+				dec->cur_stream->nDataLen = 0;
+				sim_queue_push(&(dec->streams_out), dec->cur_stream);
+				sim_queue_push(&(dec->pictures_free), dec->cur_picture);
+				dec->cur_stream = NULL;
+				dec->cur_picture = NULL;
+			}
+			if (dec->hung)
+			{
+				pthread_mutex_lock(&sim_engine_mutex);
+				--sim_engine_num_hung;
+				pthread_mutex_unlock(&sim_engine_mutex);
+				dec->hung = 0;
+			}
+			dec->stopped = 1;
+			dec->eos = 0;
+			return IPP_STATUS_NOERR;
+
+		case IPPVC_PAUSE:
+		case IPPVC_RESUME:
+			return IPP_STATUS_NOERR;
+
+		case IPPVC_END_OF_STREAM:
+			dec->eos = 1;
+			return IPP_STATUS_NOERR;
+
+		case IPPVC_SET_VC1M_SEQ_INFO:
+		{
+			vc1m_seq_header *seq_header = (vc1m_seq_header *)pInParam;
+			if (seq_header == NULL)
+				return IPP_STATUS_BADARG_ERR;
+			if ((seq_header->horiz_size > 0) && (seq_header->vert_size > 0))
+			{
+				dec->width = seq_header->horiz_size;
+				dec->height = seq_header->vert_size;
+			}
+			return IPP_STATUS_NOERR;
+		}
+
+		default:
+			return IPP_STATUS_NOTSUPPORTED_ERR;
+	}
+}
+
+
+IppCodecStatus DecoderPushBuffer_Vmeta(IppVmetaBufferType type, void *pBuf, void *pSrcDstDecoderState)
+{
+	SimDecoder *dec = (SimDecoder *)pSrcDstDecoderState;
+
+	if ((dec == NULL) || (pBuf == NULL))
+		return IPP_STATUS_BADARG_ERR;
+
+	switch (type)
+	{
+		case IPP_VMETA_BUF_TYPE_STRM:
+		{
+			IppVmetaBitstream *stream = (IppVmetaBitstream *)pBuf;
+			if ((stream->pBuf == NULL) || (stream->nDataLen > stream->nBufSize))
+				return IPP_STATUS_BADARG_ERR;
+			dec->stopped = 0;
+			return sim_queue_push(&(dec->streams_in), pBuf) ? IPP_STATUS_NOERR : IPP_STATUS_BUFFER_FULL;
+		}
+
+		case IPP_VMETA_BUF_TYPE_PIC:
+		{
+			IppVmetaPicture *picture = (IppVmetaPicture *)pBuf;
+			if (picture->pBuf == NULL)
+				return IPP_STATUS_BADARG_ERR;
+			return sim_queue_push(&(dec->pictures_free), pBuf) ? IPP_STATUS_NOERR : IPP_STATUS_BUFFER_FULL;
+		}
+
+		default:
+			return IPP_STATUS_BADARG_ERR;
+	}
+}
+
+
+IppCodecStatus DecoderPopBuffer_Vmeta(IppVmetaBufferType type, void **ppBuf, void *pSrcDstDecoderState)
+{
+	SimDecoder *dec = (SimDecoder *)pSrcDstDecoderState;
+
+	if ((dec == NULL) || (ppBuf == NULL))
+		return IPP_STATUS_BADARG_ERR;
+
+	switch (type)
+	{
+		case IPP_VMETA_BUF_TYPE_STRM:
+		{
+			*ppBuf = sim_queue_pop(&(dec->streams_out));
+
+			/* Streams which were not yet consumed are only given back
+			 * once the engine has been stopped */
+			if ((*ppBuf == NULL) && dec->stopped)
+				*ppBuf = sim_queue_pop(&(dec->streams_in));
+
+			return IPP_STATUS_NOERR;
+		}
+
+		case IPP_VMETA_BUF_TYPE_PIC:
+		{
+			/* Completed pictures come first; if there are none, the caller is
+			 * retrieving all pictures, as it does after a new sequence or when
+			 * flushing, so unused and held pictures are given back, and an
+			 * ongoing decode is aborted */
+			*ppBuf = sim_queue_pop(&(dec->pictures_out));
+			if (*ppBuf == NULL)
+				*ppBuf = sim_queue_pop(&(dec->pictures_free));
+			if (*ppBuf == NULL)
+				*ppBuf = sim_queue_pop(&(dec->pictures_dpb));
+			if ((*ppBuf == NULL) && (dec->cur_picture != NULL))
+			{
+				*ppBuf = dec->cur_picture;
+				dec->cur_picture = NULL;
+				dec->cur_stream->nDataLen = 0;
+				sim_queue_push(&(dec->streams_out), dec->cur_stream);
+				dec->cur_stream = NULL;
+			}
+
+			return IPP_STATUS_NOERR;
+		}
+
+		default:
+			return IPP_STATUS_BADARG_ERR;
+	}
+}